@@ -0,0 +1,93 @@
+/*
+   mkvpropedit -- utility for editing properties of existing Matroska files
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   benchmark measuring what debug and verbose messages cost per edit
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include <chrono>
+#include <fstream>
+
+#include "common/strings/parsing.h"
+#include "propedit/propedit.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+static void
+copy_file(std::string const &source,
+          std::string const &destination) {
+  std::ifstream in{source, std::ios::binary};
+  std::ofstream out{destination, std::ios::binary};
+
+  out << in.rdbuf();
+}
+
+template<typename F> int64_t
+time_per_run_in_ns(int64_t num_runs,
+                   F const &function) {
+  auto start = bench_clock::now();
+
+  for (auto run = 0; run < num_runs; ++run)
+    function(run);
+
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count() / num_runs;
+}
+
+/** \brief Times edits and the messages printed along the way
+
+   Usage: <file name> [number of edits]
+
+   Copies the file and sets the first track's name in the copy the
+   given number of times, each time on a fresh copy. The time copying
+   takes is reported separately. A file whose last level 1 element has
+   an unknown size also passes through
+   \c fix_unknown_size_for_last_level1_element() on each edit.
+
+   For comparison the cost of a verbose message that isn't shown and
+   the cost of formatting the same message unconditionally are
+   reported, too. Pass the usual debugging options through the
+   environment (e.g. MTX_DEBUG) to see how enabling them changes the
+   numbers.
+*/
+int
+main(int argc,
+     char **argv) {
+  int64_t num_edits = 400;
+
+  if ((2 > argc) || (3 < argc) || ((3 == argc) && (!parse_number(argv[2], num_edits) || (0 >= num_edits)))) {
+    fprintf(stderr, "Usage: %s <file name> [number of edits]\n", argv[0]);
+    return 2;
+  }
+
+  std::string source{argv[1]}, copy{source + ".debug-logging-benchmark"};
+  auto name = std::string(300, 'z');
+  auto edit = [&copy, &name]() {
+    mtx::propedit::edit_job_c job{copy};
+    job.set_parse_mode_full(true).edit("track:1").set("name=" + name).run();
+  };
+
+  // Warm up the page cache and initialize the library.
+  copy_file(source, copy);
+  edit();
+
+  auto copy_time = time_per_run_in_ns(num_edits, [&](int) { copy_file(source, copy); });
+  auto edit_time = time_per_run_in_ns(num_edits, [&](int) { copy_file(source, copy); edit(); });
+
+  std::remove(copy.c_str());
+
+  auto num_formatted = std::size_t{};
+  auto hidden_time   = time_per_run_in_ns(1000000, [](int run) { mxverb(2, strformat::bstr("Element %1% is written.\n") % run); });
+  auto format_time   = time_per_run_in_ns(1000000, [&num_formatted](int run) { num_formatted += (strformat::bstr("Element %1% is written.\n") % run).str().size(); });
+
+  mxinfo(strformat::bstr("copy: %1% ns; edit including copy: %2% ns; edit alone: %3% ns\n") % copy_time % edit_time % (edit_time - copy_time));
+  mxinfo(strformat::bstr("verbose message not shown: %1% ns; formatted unconditionally: %2% ns (%3% bytes)\n") % hidden_time % format_time % num_formatted);
+
+  return 0;
+}
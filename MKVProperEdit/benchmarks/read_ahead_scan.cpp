@@ -0,0 +1,119 @@
+/*
+   mkvpropedit -- utility for editing properties of existing Matroska files
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   benchmark comparing a full analysis with its I/O and CPU parts
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include <chrono>
+#include <thread>
+
+#include "common/kax_analyzer.h"
+#include "common/strings/parsing.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+/** \brief A local file standing in for a file on slow storage
+
+   Every read sleeps as long as reading its amount of data at the
+   configured bandwidth would take. The time spent sleeping is the
+   time the analysis spends waiting for I/O.
+*/
+class mm_throttled_io_c: public mm_proxy_io_c {
+protected:
+  double m_bytes_per_second;
+  bench_clock::duration m_io_time;
+
+public:
+  mm_throttled_io_c(mm_io_c *in, double bytes_per_second)
+    : mm_proxy_io_c{in}
+    , m_bytes_per_second{bytes_per_second}
+    , m_io_time{}
+  {
+  }
+
+  virtual int64_t get_size() {
+    return m_proxy_io->get_size();
+  }
+
+  bench_clock::duration get_io_time() const {
+    return m_io_time;
+  }
+
+protected:
+  virtual uint32 _read(void *buffer, size_t size) {
+    auto start = bench_clock::now();
+
+    std::this_thread::sleep_for(std::chrono::duration<double>{size / m_bytes_per_second});
+    auto num_read = m_proxy_io->read(buffer, size);
+
+    m_io_time += bench_clock::now() - start;
+
+    return num_read;
+  }
+};
+
+static int64_t
+to_ms(bench_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+static bench_clock::duration
+analyze(mm_io_c *file) {
+  auto start = bench_clock::now();
+
+  kax_analyzer_c analyzer{file};
+  analyzer.set_parse_mode(kax_analyzer_c::parse_mode_full);
+
+  if (!analyzer.process())
+    mxerror("The file could not be analyzed.\n");
+
+  return bench_clock::now() - start;
+}
+
+/** \brief Fully analyzes a file with and without a simulated slow disk
+
+   Usage: <bandwidth in MB/s> <file name>
+
+   The CPU time is taken from an analysis of the file while it is in
+   the page cache. The I/O time is the time the reads of an analysis
+   through the throttled file take. The clusters are read ahead in
+   the background while the previous block is decoded, so the
+   throttled analysis should take about as long as the longer of the
+   two and not as long as their sum.
+*/
+int
+main(int argc,
+     char **argv) {
+  mtx_common_init("read_ahead_scan", argv[0]);
+
+  int64_t bandwidth = 0;
+
+  if ((3 != argc) || !parse_number(argv[1], bandwidth) || (0 >= bandwidth)) {
+    fprintf(stderr, "Usage: %s <bandwidth in MB/s> <file name>\n", argv[0]);
+    return 2;
+  }
+
+  // Once for the page cache, then for the measurement.
+  mm_file_io_c warm_up{argv[2]};
+  analyze(&warm_up);
+
+  mm_file_io_c cached{argv[2]};
+  auto cpu_time = analyze(&cached);
+
+  mm_throttled_io_c throttled{new mm_file_io_c{argv[2]}, bandwidth * 1000000.0};
+  auto scan_time = analyze(&throttled);
+  auto io_time   = throttled.get_io_time();
+
+  mxinfo(strformat::bstr("CPU: %1% ms; I/O: %2% ms; scan: %3% ms; sum: %4% ms; max: %5% ms\n")
+         % to_ms(cpu_time) % to_ms(io_time) % to_ms(scan_time) % to_ms(cpu_time + io_time) % to_ms(std::max(cpu_time, io_time)));
+
+  return 0;
+}
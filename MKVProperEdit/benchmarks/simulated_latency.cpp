@@ -0,0 +1,179 @@
+/*
+   mkvpropedit -- utility for editing properties of existing Matroska files
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   benchmark counting the round trips an edit needs on high-latency storage
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "common/mm_block_cache_io.h"
+#include "common/mm_io_x.h"
+#include "common/mm_positional_io.h"
+#include "common/mm_write_back_io.h"
+#include "common/strings/parsing.h"
+#include "propedit/propedit.h"
+
+/** \brief A local file standing in for a file on high-latency storage
+
+   Every access sleeps for the configured latency before it is
+   executed and is counted as one round trip. Its callbacks are meant
+   for \c mm_block_cache_io_c.
+*/
+class mm_latency_file_c {
+protected:
+  mm_positional_io_c m_file;
+  std::chrono::microseconds m_latency;
+  std::atomic<uint64_t> m_num_round_trips;
+
+public:
+  mm_latency_file_c(std::string const &file_name, open_mode mode, std::chrono::microseconds latency);
+
+  size_t fetch(uint64_t position, unsigned char *buffer, size_t size);
+  void store(uint64_t position, unsigned char const *buffer, size_t size);
+  void truncate(uint64_t size);
+
+  uint64_t get_size();
+  uint64_t get_num_round_trips() const;
+  mm_block_cache_io_c::callbacks_t get_callbacks();
+
+protected:
+  void wait_for_round_trip();
+};
+
+using mm_latency_file_cptr = std::shared_ptr<mm_latency_file_c>;
+
+mm_latency_file_c::mm_latency_file_c(std::string const &file_name,
+                                     open_mode mode,
+                                     std::chrono::microseconds latency)
+  : m_file{file_name, mode}
+  , m_latency{latency}
+  , m_num_round_trips{}
+{
+}
+
+void
+mm_latency_file_c::wait_for_round_trip() {
+  ++m_num_round_trips;
+  std::this_thread::sleep_for(m_latency);
+}
+
+size_t
+mm_latency_file_c::fetch(uint64_t position,
+                         unsigned char *buffer,
+                         size_t size) {
+  wait_for_round_trip();
+
+  // Fetches may run concurrently; each one uses its own cursor.
+  mm_positional_io_c cursor{m_file};
+  cursor.setFilePointer(position);
+
+  return cursor.read(buffer, size);
+}
+
+void
+mm_latency_file_c::store(uint64_t position,
+                         unsigned char const *buffer,
+                         size_t size) {
+  wait_for_round_trip();
+
+  mm_positional_io_c cursor{m_file};
+  cursor.setFilePointer(position);
+
+  if (cursor.write(buffer, size) != size)
+    throw mtx::mm_io::read_write_x{};
+}
+
+void
+mm_latency_file_c::truncate(uint64_t size) {
+  wait_for_round_trip();
+  m_file.truncate(size);
+}
+
+uint64_t
+mm_latency_file_c::get_size() {
+  return m_file.get_size();
+}
+
+uint64_t
+mm_latency_file_c::get_num_round_trips()
+  const {
+  return m_num_round_trips;
+}
+
+mm_block_cache_io_c::callbacks_t
+mm_latency_file_c::get_callbacks() {
+  mm_block_cache_io_c::callbacks_t callbacks;
+
+  callbacks.m_fetch    = [this](uint64_t position, unsigned char *buffer, size_t size) { return fetch(position, buffer, size); };
+  callbacks.m_store    = [this](uint64_t position, unsigned char const *buffer, size_t size) { store(position, buffer, size); };
+  callbacks.m_truncate = [this](uint64_t size) { truncate(size); };
+
+  return callbacks;
+}
+
+// ------------------------------------------------------------
+
+struct simulated_storage_t {
+  std::string m_file_name;
+  mm_latency_file_cptr m_latency_file;
+  mm_block_cache_io_cptr m_block_cache;
+};
+
+/** \brief Runs mkvpropedit on files behind simulated high-latency storage
+
+   Usage: <latency in microseconds> <mkvpropedit arguments>
+
+   Each edited file is accessed through a block cache and a write-back
+   buffer on top of a local file whose every access is delayed by the
+   given latency. The number of round trips and the cache statistics
+   are reported for each file after the edit.
+*/
+int
+main(int argc,
+     char **argv) {
+  int64_t latency_us = 0;
+
+  if ((3 > argc) || !parse_number(argv[1], latency_us) || (0 > latency_us)) {
+    fprintf(stderr, "Usage: %s <latency in microseconds> <mkvpropedit arguments>\n", argv[0]);
+    return 2;
+  }
+
+  std::mutex mutex;
+  std::vector<simulated_storage_t> storages;
+
+  mtx::propedit::set_file_opener([latency_us, &mutex, &storages](std::string const &file_name) -> mm_io_cptr {
+    auto latency_file = std::make_shared<mm_latency_file_c>(file_name, MODE_WRITE, std::chrono::microseconds{latency_us});
+    auto block_cache  = std::make_shared<mm_block_cache_io_c>(file_name, latency_file->get_size(), latency_file->get_callbacks());
+
+    std::lock_guard<std::mutex> lock{mutex};
+    storages.push_back({ file_name, latency_file, block_cache });
+
+    return std::make_shared<mm_write_back_io_c>(block_cache.get(), 4 * 1024 * 1024, false);
+  });
+
+  std::vector<char *> arguments{ argv[0] };
+  arguments.insert(arguments.end(), argv + 2, argv + argc);
+
+  run_edit(arguments.size(), arguments.data());
+
+  for (auto const &storage : storages) {
+    auto const &statistics = storage.m_block_cache->get_statistics();
+    mxinfo(strformat::bstr("'%1%': %2% round trips; %3% fetches (%4% prefetches) with %5% bytes; %6% stores with %7% bytes; block hits: %8%; misses: %9%\n")
+           % storage.m_file_name % storage.m_latency_file->get_num_round_trips()
+           % statistics.m_num_fetches % statistics.m_num_prefetches % statistics.m_num_fetched_bytes
+           % statistics.m_num_stores % statistics.m_num_stored_bytes % statistics.m_num_block_hits % statistics.m_num_block_misses);
+  }
+
+  return 0;
+}
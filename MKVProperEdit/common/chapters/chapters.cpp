@@ -561,7 +561,8 @@ remove_elements_unsupported_by_webm(EbmlMaster &master) {
     if (e && s_readd_with_defaults[ EBML_ID_VALUE(EbmlId(*e)) ]) {
       auto new_with_defaults = &(e->CreateElement());
       delete e;
-      master.GetElementList()[idx] = new_with_defaults;
+      master.Remove(idx);
+      master.InsertElement(*new_with_defaults, idx);
 
       ++idx;
 
@@ -72,7 +72,7 @@ fix_windows_errormode() {
 
 // Global and static variables
 
-unsigned int verbose = 1;
+thread_local unsigned int verbose = 1;
 
 extern bool g_warning_issued;
 static std::string s_program_name;
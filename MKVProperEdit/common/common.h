@@ -234,7 +234,7 @@ void mxrun_before_exit(std::function<void()> function);
 void mxexit(int code = -1);
 void set_process_priority(int priority);
 
-extern unsigned int verbose;
+extern thread_local unsigned int verbose;
 
 void mtx_common_init(std::string const &program_name, char const *argv0);
 std::string const &get_program_name();
@@ -100,6 +100,19 @@ debugging_c::output(std::string const &msg) {
     mxmsg(MXMSG_INFO, msg);
 }
 
+void
+debugging_c::output(char const *file_name,
+                    unsigned int line,
+                    std::string const &msg) {
+  // The line number is padded to four digits so that consecutive
+  // messages from the same file line up.
+  auto line_str = std::to_string(line);
+  if (line_str.size() < 4)
+    line_str.insert(0, 4 - line_str.size(), '0');
+
+  output(std::string{"Debug> "} + file_name + ":" + line_str + ": " + msg);
+}
+
 void
 debugging_c::hexdump(const void *buffer_to_dump,
                      size_t length) {
@@ -156,23 +169,28 @@ debugging_c::hexdump(memory_c const &buffer_to_dump,
 
 // ------------------------------------------------------------
 
-std::vector<debugging_option_c::option_c> debugging_option_c::ms_registered_options;
+std::vector<std::unique_ptr<debugging_option_c::option_c>> debugging_option_c::ms_registered_options;
+std::mutex debugging_option_c::ms_mutex;
 
-size_t
+debugging_option_c::option_c *
 debugging_option_c::register_option(std::string const &option) {
-  auto itr = brng::find_if(ms_registered_options, [&option](option_c const &opt) { return opt.m_option == option; });
+  std::lock_guard<std::mutex> lock{ms_mutex};
+
+  auto itr = brng::find_if(ms_registered_options, [&option](std::unique_ptr<option_c> const &opt) { return opt->m_option == option; });
   if (itr != ms_registered_options.end())
-    return std::distance(ms_registered_options.begin(), itr);
+    return itr->get();
 
-  ms_registered_options.emplace_back(option);
+  ms_registered_options.emplace_back(new option_c{option});
 
-  return ms_registered_options.size() - 1;
+  return ms_registered_options.back().get();
 }
 
 void
 debugging_option_c::invalidate_cache() {
+  std::lock_guard<std::mutex> lock{ms_mutex};
+
   for (auto &opt : ms_registered_options)
-    opt.m_requested = boost::logic::indeterminate;
+    opt->m_requested = -1;
 }
 
 // ------------------------------------------------------------
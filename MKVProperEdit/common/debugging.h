@@ -15,6 +15,8 @@
 
 #include "common/common_pch.h"
 
+#include <atomic>
+#include <mutex>
 #include <sstream>
 #include <unordered_map>
 //#include <boost/common/tribool>
@@ -32,6 +34,10 @@ public:
   static void output(strformat::bstr const &msg) {
     output(msg.str());
   }
+  static void output(char const *file_name, unsigned int line, std::string const &msg);
+  static void output(char const *file_name, unsigned int line, strformat::bstr const &msg) {
+    output(file_name, line, msg.str());
+  }
 
   static void hexdump(const void *buffer_to_dump, size_t lenth);
   static void hexdump(memory_c const &buffer_to_dump, mbalgm::optional<std::size_t> max_length = mbalgm::optional<std::size_t>());
@@ -47,60 +53,77 @@ public:
 
 class debugging_option_c {
   struct option_c {
-    boost::tribool m_requested;
+    std::atomic<int> m_requested;   // -1: not determined yet
     std::string m_option;
 
     option_c(std::string const &option)
-      : m_requested{boost::logic::indeterminate}
+      : m_requested{-1}
       , m_option{option}
     {
     }
 
     bool get() {
-      if (boost::logic::indeterminate(m_requested))
-        m_requested = debugging_c::requested(m_option);
+      auto requested = m_requested.load(std::memory_order_relaxed);
+      if (0 > requested) {
+        requested = debugging_c::requested(m_option) ? 1 : 0;
+        m_requested.store(requested, std::memory_order_relaxed);
+      }
 
-        return (bool)m_requested;
+      return !!requested;
     }
   };
 
 protected:
-  mutable size_t m_registered_idx;
+  mutable std::atomic<option_c *> m_registered;
   std::string m_option;
 
 private:
-  static std::vector<option_c> ms_registered_options;
+  // The options are registered lazily from any thread. Their entries
+  // are never freed so that each debugging_option_c can keep a
+  // pointer to its entry.
+  static std::vector<std::unique_ptr<option_c>> ms_registered_options;
+  static std::mutex ms_mutex;
 
 public:
   debugging_option_c(std::string const &option)
-    : m_registered_idx{std::numeric_limits<size_t>::max()}
+    : m_registered{}
     , m_option{option}
   {
   }
 
+  debugging_option_c(debugging_option_c const &other)
+    : m_registered{other.m_registered.load()}
+    , m_option{other.m_option}
+  {
+  }
+
   operator bool() const {
-    return ms_registered_options.at(get_idx()).get();
+    return get_registered().get();
   }
 
   void set(boost::tribool requested) {
-    ms_registered_options.at(get_idx()).m_requested = requested;
+    get_registered().m_requested = boost::logic::indeterminate(requested) ? -1 : requested ? 1 : 0;
   }
 
 protected:
-  std::size_t get_idx() const {
-    if (m_registered_idx == std::numeric_limits<size_t>::max())
-      m_registered_idx = register_option(m_option);
+  option_c &get_registered() const {
+    auto registered = m_registered.load(std::memory_order_acquire);
+    if (!registered) {
+      registered = register_option(m_option);
+      m_registered.store(registered, std::memory_order_release);
+    }
 
-    return m_registered_idx;
+    return *registered;
   }
 
 public:
-  static size_t register_option(std::string const &option);
+  static option_c *register_option(std::string const &option);
   static void invalidate_cache();
 };
 
-#define mxdebug(msg) debugging_c::output((strformat::bstr("Debug> %1%:%|2$04d|: %3%") % __FILE__ % __LINE__ % (msg)).str())
+#define mxdebug(msg) debugging_c::output(__FILE__, __LINE__, (msg))
 
+// The message is only formatted if the condition is true.
 #define mxdebug_if(condition, msg) \
   if (condition) {                 \
     mxdebug(msg);                  \
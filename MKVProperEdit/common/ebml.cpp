@@ -106,7 +106,9 @@ do_find_ebml_callbacks(EbmlCallbacks const &base,
 EbmlCallbacks const *
 find_ebml_callbacks(EbmlCallbacks const &base,
                     EbmlId const &id) {
-  static std::unordered_map<uint32_t, EbmlCallbacks const *> s_cache;
+  // The lookup caches are kept per thread so that concurrent jobs
+  // don't have to synchronize their accesses.
+  static thread_local std::unordered_map<uint32_t, EbmlCallbacks const *> s_cache;
 
   auto itr = s_cache.find(id.GetValue());
   if (itr != s_cache.end())
@@ -146,7 +148,7 @@ do_find_ebml_callbacks(EbmlCallbacks const &base,
 EbmlCallbacks const *
 find_ebml_callbacks(EbmlCallbacks const &base,
                     char const *debug_name) {
-  static std::unordered_map<std::string, EbmlCallbacks const *> s_cache;
+  static thread_local std::unordered_map<std::string, EbmlCallbacks const *> s_cache;
 
   auto itr = s_cache.find(debug_name);
   if (itr != s_cache.end())
@@ -183,7 +185,7 @@ do_find_ebml_parent_callbacks(EbmlCallbacks const &base,
 EbmlCallbacks const *
 find_ebml_parent_callbacks(EbmlCallbacks const &base,
                            EbmlId const &id) {
-  static std::unordered_map<uint32_t, EbmlCallbacks const *> s_cache;
+  static thread_local std::unordered_map<uint32_t, EbmlCallbacks const *> s_cache;
 
   auto itr = s_cache.find(id.GetValue());
   if (itr != s_cache.end())
@@ -220,7 +222,7 @@ do_find_ebml_semantic(EbmlCallbacks const &base,
 EbmlSemantic const *
 find_ebml_semantic(EbmlCallbacks const &base,
                    EbmlId const &id) {
-  static std::unordered_map<uint32_t, EbmlSemantic const *> s_cache;
+  static thread_local std::unordered_map<uint32_t, EbmlSemantic const *> s_cache;
 
   auto itr = s_cache.find(id.GetValue());
   if (itr != s_cache.end())
@@ -383,7 +385,7 @@ find_element_in_master(EbmlMaster *master,
 
 static std::unordered_map<uint32_t, bool> const &
 get_deprecated_elements_by_id() {
-  static std::unordered_map<uint32_t, bool> s_elements;
+  static thread_local std::unordered_map<uint32_t, bool> s_elements;
 
   if (!s_elements.empty())
     return s_elements;
@@ -643,7 +645,7 @@ must_be_present_in_master_by_id(EbmlId const &id) {
 
 bool
 must_be_present_in_master(EbmlCallbacks const &callbacks) {
-  static std::unordered_map<uint32_t, bool> s_must_be_present;
+  static thread_local std::unordered_map<uint32_t, bool> s_must_be_present;
 
   auto id  = callbacks.ClassId();
   auto itr = s_must_be_present.find(id.GetValue());
@@ -14,15 +14,20 @@
 #include "common/common_pch.h"
 
 #include <algorithm>
+#include <iomanip>
+#include <thread>
 
+#include <ebml/EbmlCrc32.h>
 #include <ebml/EbmlStream.h>
 #include <ebml/EbmlSubHead.h>
 #include <ebml/EbmlVoid.h>
 #include <matroska/KaxCluster.h>
+#include <matroska/KaxInfoData.h>
 #include <matroska/KaxSeekHead.h>
 #include <matroska/KaxSegment.h>
 #include <matroska/KaxTags.h>
 
+#include "common/at_scope_exit.h"
 #include "common/bitvalue.h"
 #include "common/construct.h"
 #include "common/ebml.h"
@@ -30,9 +35,18 @@
 #include "common/error.h"
 #include "common/list_utils.h"
 #include "common/kax_analyzer.h"
+#include "common/kax_analyzer_layout_cache.h"
+#include "common/kax_file.h"
+#include "common/mm_accounting_io.h"
 #include "common/mm_io_x.h"
+#include "common/mm_mmap_io.h"
+#include "common/mm_positional_io.h"
 #include "common/mm_read_buffer_io.h"
+#include "common/mm_transaction_io.h"
+#include "common/mm_write_back_io.h"
 #include "common/strings/editing.h"
+#include "common/tracing.h"
+#include "common/vint.h"
 
 using namespace libebml;
 using namespace libmatroska;
@@ -41,12 +55,54 @@ using namespace libmatroska;
 
 #define CONSOLE_PERCENTAGE_WIDTH 25
 
+// Sizes of the reads done while skimming over clusters. Small reads
+// are used once clusters turn out to be larger than the big buffer.
+#define SKIM_BUFFER_SIZE       (1024 * 1024)
+#define SKIM_SMALL_BUFFER_SIZE 4096
+
+// Each range skimmed by its own thread covers at least this many
+// bytes. Smaller ranges aren't worth the cost of resyncing.
+#define PARALLEL_ANALYSIS_MIN_RANGE_SIZE (16 * 1024 * 1024)
+
+// Size of the buffer used for moving element data around in the
+// file. Memory usage doesn't depend on the size of the data moved.
+#define COPY_BUFFER_SIZE (1024 * 1024)
+
+// How much of each element referenced by a meta seek element is
+// fetched ahead of time on storage with a high latency.
+#define SEEK_TARGET_PREFETCH_SIZE (16 * 1024)
+
+// Size of the chunks in which an element patched in place is compared
+// with its current content.
+#define PATCH_CHUNK_SIZE (64 * 1024)
+
+// How much memory the changes of a batch update may occupy before it
+// is split into one update per element.
+#define MAX_TRANSACTION_SIZE (64 * 1024 * 1024)
+
 bool
 operator <(const kax_analyzer_data_cptr &d1,
            const kax_analyzer_data_cptr &d2) {
   return d1->m_pos < d2->m_pos;
 }
 
+bool
+kax_analyzer_c::padding_policy_t::is_enabled()
+  const {
+  return (0 < m_size) || (0 < m_percentage);
+}
+
+int64_t
+kax_analyzer_c::padding_policy_t::get_padding_for(int64_t element_size)
+  const {
+  if (!is_enabled())
+    return 0;
+
+  // The padding is turned into an EbmlVoid element which needs at
+  // least two bytes.
+  return std::max<int64_t>(std::max<int64_t>(m_size, element_size * m_percentage / 100), 2);
+}
+
 std::string
 kax_analyzer_data_c::to_string() const {
   const EbmlCallbacks *callbacks = find_ebml_callbacks(EBML_INFO(KaxSegment), m_id);
@@ -59,8 +115,9 @@ kax_analyzer_data_c::to_string() const {
     name = EBML_INFO_NAME(*callbacks);
 
   else {
-    std::string format = (strformat::bstr("0x%%|0%1%x|") % (EBML_ID_LENGTH(m_id) * 2)).str();
-    name               = (strformat::bstr(format)        %  EBML_ID_VALUE(m_id)).str();
+    std::stringstream id;
+    id << "0x" << std::hex << std::setfill('0') << std::setw(EBML_ID_LENGTH(m_id) * 2) << EBML_ID_VALUE(m_id);
+    name = id.str();
   }
 
   return (strformat::bstr("%1% size %2%%4% at %3%") % name % m_size % m_pos % (m_size_known ? "" : " (unknown)")).str();
@@ -85,6 +142,19 @@ kax_analyzer_c::~kax_analyzer_c() {
 
 void
 kax_analyzer_c::close_file() {
+  mtx::tracing::span_c span{"close_file"};
+
+  // The segment UID is part of the layout cache's key. It has to be
+  // read before the file is closed.
+  memory_cptr segment_uid;
+  if (m_layout_cache_needs_saving && m_file && !m_layout_cache_invalid) {
+    try {
+      segment_uid = read_segment_uid();
+    } catch (...) {
+      m_layout_cache_invalid = true;
+    }
+  }
+
   if (m_close_file) {
     delete m_file;
     m_file = nullptr;
@@ -92,6 +162,24 @@ kax_analyzer_c::close_file() {
     delete m_stream;
     m_stream = nullptr;
   }
+
+  if (m_layout_cache_needs_saving || m_layout_cache_invalid)
+    save_layout_cache(segment_uid);
+
+  m_layout_cache_needs_saving = false;
+  m_layout_cache_invalid      = false;
+}
+
+/** \brief Wraps a file in an accounting proxy if I/O accounting is enabled
+
+   The proxy is placed directly around the file's system level
+   implementation so that only operations that reach the operating
+   system are counted and not the ones served by buffers above it.
+ */
+static mm_io_c *
+count_io(mm_io_c *file,
+         mm_io_accounting_cptr const &accounting) {
+  return accounting ? new mm_accounting_io_c{file, accounting} : file;
 }
 
 void
@@ -100,9 +188,18 @@ kax_analyzer_c::reopen_file() {
     return;
 
   try {
-    m_file = new mm_file_io_c(m_file_name, m_open_mode);
-    if (MODE_READ == m_open_mode)
-      m_file = new mm_read_buffer_io_c(m_file);
+    if (MODE_READ == m_open_mode) {
+      try {
+        m_file = new mm_mmap_io_c(m_file_name);
+      } catch (mtx::mm_io::open_x &) {
+        m_file = new mm_read_buffer_io_c(count_io(new mm_file_io_c(m_file_name, m_open_mode), m_io_accounting));
+      }
+
+    } else
+      // Updates consist of many small writes scattered over the
+      // file's head. Collect them so that they reach the file in one
+      // go and in order.
+      m_file = new mm_write_back_io_c(count_io(new mm_file_io_c(m_file_name, m_open_mode), m_io_accounting));
 
   } catch (mtx::mm_io::exception &) {
     delete m_file;
@@ -119,6 +216,10 @@ kax_analyzer_c::reopen_file_for_writing() {
   if (m_file && (MODE_WRITE == m_open_mode))
     return;
 
+  // Reopening the file invalidates the references of lazily read
+  // payloads to it.
+  load_lazy_payloads();
+
   delete m_file;
   m_file      = nullptr;
   m_open_mode = MODE_WRITE;
@@ -126,6 +227,17 @@ kax_analyzer_c::reopen_file_for_writing() {
   reopen_file();
 }
 
+/** \brief Writes the data buffered for the file
+
+   Most writes of an update only reach the file at this point.
+ */
+void
+kax_analyzer_c::flush_file() {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "flush"};
+
+  m_file->flush();
+}
+
 void
 kax_analyzer_c::_log_debug_message(const std::string &message) {
   mxinfo(message);
@@ -140,11 +252,11 @@ void
 kax_analyzer_c::debug_dump_elements() {
   size_t i;
   for (i = 0; i < m_data.size(); i++)
-    log_debug_message(strformat::bstr("%1%: %2%\n") % i % m_data[i]->to_string());
+    log_debug_message(strformat::bstr("%1%: %2%\n") % i % kax_analyzer_data_c{m_data, i}.to_string());
 }
 
 void
-kax_analyzer_c::debug_dump_elements_maybe(const std::string &hook_name) {
+kax_analyzer_c::debug_dump_elements_maybe(char const *hook_name) {
   if (!analyzer_debugging_requested(hook_name))
     return;
 
@@ -153,24 +265,47 @@ kax_analyzer_c::debug_dump_elements_maybe(const std::string &hook_name) {
 }
 
 void
-kax_analyzer_c::validate_data_structures(const std::string &hook_name) {
+kax_analyzer_c::validate_data_structures(char const *hook_name) {
   if (m_data.empty())
     return;
 
-  bool gap_debugging = analyzer_debugging_requested("gaps");
+  bool gap_debugging = m_debug_gaps;
   bool ok            = true;
   size_t i;
 
   for (i = 0; m_data.size() -1 > i; i++) {
-    if ((m_data[i]->m_pos + m_data[i]->m_size) > m_data[i + 1]->m_pos) {
+    if ((m_data.get_pos(i) + m_data.get_size(i)) > m_data.get_pos(i + 1)) {
       log_debug_message(strformat::bstr("kax_analyzer_%1%: Interal data structure corruption at pos %2% (size + position > next position); dumping elements\n") % hook_name % i);
       ok = false;
-    } else if (gap_debugging && ((m_data[i]->m_pos + m_data[i]->m_size) < m_data[i + 1]->m_pos)) {
+    } else if (gap_debugging && ((m_data.get_pos(i) + m_data.get_size(i)) < m_data.get_pos(i + 1))) {
       log_debug_message(strformat::bstr("kax_analyzer_%1%: Gap found at pos %2% (size + position < next position); dumping elements\n") % hook_name % i);
       ok = false;
     }
   }
 
+  if (ok && m_free_space_valid) {
+    auto const &areas = m_free_space.get_areas();
+    size_t num_voids  = 0;
+
+    for (i = 0; m_data.size() > i; ++i) {
+      if (!Is<EbmlVoid>(m_data.get_id(i)))
+        continue;
+
+      ++num_voids;
+      auto itr = areas.find(m_data.get_pos(i));
+      if ((itr == areas.end()) || (itr->second != m_data.get_size(i))) {
+        log_debug_message(strformat::bstr("kax_analyzer_%1%: Free space map out of sync at pos %2%; dumping elements\n") % hook_name % i);
+        ok = false;
+        break;
+      }
+    }
+
+    if (ok && (num_voids != areas.size())) {
+      log_debug_message(strformat::bstr("kax_analyzer_%1%: Free space map contains %2% areas but there are %3% void elements; dumping elements\n") % hook_name % areas.size() % num_voids);
+      ok = false;
+    }
+  }
+
   if (!ok) {
     debug_dump_elements();
 
@@ -182,7 +317,7 @@ kax_analyzer_c::validate_data_structures(const std::string &hook_name) {
 }
 
 void
-kax_analyzer_c::verify_data_structures_against_file(const std::string &hook_name) {
+kax_analyzer_c::verify_data_structures_against_file(char const *hook_name) {
   kax_analyzer_c actual_content(m_file);
   actual_content.process();
 
@@ -193,8 +328,8 @@ kax_analyzer_c::verify_data_structures_against_file(const std::string &hook_name
   size_t i;
 
   for (i = 0; num_items > i; ++i) {
-    info_this.push_back(                 m_data.size() > i ?                m_data[i]->to_string() : empty_string);
-    info_actual.push_back(actual_content.m_data.size() > i ? actual_content.m_data[i]->to_string() : empty_string);
+    info_this.push_back(                 m_data.size() > i ? kax_analyzer_data_c{               m_data, i}.to_string() : empty_string);
+    info_actual.push_back(actual_content.m_data.size() > i ? kax_analyzer_data_c{actual_content.m_data, i}.to_string() : empty_string);
 
     max_info_len           = std::max(max_info_len, info_this.back().length());
 
@@ -208,10 +343,8 @@ kax_analyzer_c::verify_data_structures_against_file(const std::string &hook_name
     return;
 
   log_debug_message(strformat::bstr("verify_data_structures_against_file(%1%) failed. Dumping this on the left, actual on the right.\n") % hook_name);
-  std::string format = (strformat::bstr("%%1%% %%|2$-%1%s| %%3%%\n") % max_info_len).str();
-
   for (i = 0; num_items > i; ++i)
-    log_debug_message(strformat::bstr(format) % info_markings[i] % info_this[i] % info_actual[i]);
+    log_debug_message(strformat::bstr("%1% %2% %3%\n") % info_markings[i] % (info_this[i] + std::string(max_info_len - info_this[i].size(), ' ')) % info_actual[i]);
 
   debug_abort_process();
 }
@@ -255,8 +388,82 @@ kax_analyzer_c::set_parser_start_position(uint64_t position) {
   return *this;
 }
 
+kax_analyzer_c &
+kax_analyzer_c::set_layout_cache(bool use_layout_cache) {
+  // The cache is only written when the file is closed. This requires
+  // the analyzer to own the file.
+  m_use_layout_cache = use_layout_cache && m_close_file;
+  return *this;
+}
+
+kax_analyzer_c &
+kax_analyzer_c::set_analysis_threads(unsigned int num_threads) {
+  m_num_analysis_threads = std::max(num_threads, 1u);
+  return *this;
+}
+
+kax_analyzer_c &
+kax_analyzer_c::set_padding_policy(padding_policy_t const &padding_policy) {
+  m_padding_policy = padding_policy;
+  return *this;
+}
+
+/** \brief Counts the I/O operations done by each phase of the analysis and updates
+
+   Only files opened by the analyzer itself are counted. Reads from
+   mapped files aren't counted as they don't cause any I/O calls. The
+   setting takes effect the next time the file is opened, e.g. by
+   \c process().
+ */
+kax_analyzer_c &
+kax_analyzer_c::set_io_accounting(bool enable) {
+  if (!enable || !m_close_file)
+    m_io_accounting.reset();
+
+  else if (!m_io_accounting)
+    m_io_accounting = std::make_shared<mm_io_accounting_c>();
+
+  return *this;
+}
+
+/** \brief Only reads large binary payloads when they're accessed
+
+   Elements returned by \c read_element() and \c read_all() record
+   only the positions of binary payloads of 64 KB or more, e.g. the
+   contents of attached files. Such payloads are read on first access.
+   Until then rendering an element copies them from the file in
+   chunks. The analyzer reads them itself right before it overwrites
+   or moves the bytes they are located in, or before it reopens the
+   file. An element that has to move when it is updated is written
+   before its old instance is overwritten so that its payloads can be
+   copied from there and refer to the new copy afterwards.
+
+   The elements must not be accessed after the analyzer has closed
+   the file unless their payloads have been read with
+   \c EbmlBinary::Load().
+ */
+kax_analyzer_c &
+kax_analyzer_c::set_lazy_payloads(bool lazy_payloads) {
+  m_lazy_payloads = lazy_payloads;
+  return *this;
+}
+
+kax_analyzer_c::placement_statistics_t const &
+kax_analyzer_c::get_placement_statistics()
+  const {
+  return m_placement_statistics;
+}
+
+mm_io_accounting_cptr const &
+kax_analyzer_c::get_io_accounting()
+  const {
+  return m_io_accounting;
+}
+
 bool
 kax_analyzer_c::process() {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "analysis"};
+
   try {
     auto result = process_internal();
     mxdebug_if(m_debug, strformat::bstr("kax_analyzer: parsing file '%1%' result %2%\n") % m_file->get_file_name() % result);
@@ -274,8 +481,341 @@ kax_analyzer_c::process() {
   }
 }
 
+/** \brief Indexes consecutive clusters starting at the current file position
+
+    Reads large blocks from the file and decodes the clusters' ID and
+    size fields directly from them instead of letting libEBML create
+    and destroy an element object for each cluster. If clusters turn
+    out to be large then only small blocks around each cluster's head
+    are read.
+
+    Skimming stops at the first element that isn't a cluster with a
+    known size fitting into the segment. The file pointer is left at
+    that element's start so that the regular parser can take over.
+
+    The file is read through a buffer of the same size that reads the
+    following block in the background while the current one is
+    decoded, so the time the scan takes is close to whichever is
+    longer, reading or decoding.
+
+    If several analysis threads have been requested then the rest of
+    the segment is split into byte ranges that are skimmed
+    concurrently first (see \c skim_clusters_in_parallel).
+
+    \return \c false if the user aborted the process and \c true
+      otherwise.
+ */
+bool
+kax_analyzer_c::skim_clusters(int64_t file_size) {
+  auto position    = m_file->getFilePointer();
+  auto num_entries = m_data.size();
+  auto progress    = [this, file_size](uint64_t current_position) {
+    return show_progress_running((int)(current_position * 100 / file_size));
+  };
+
+  auto result = false;
+
+  {
+    mm_read_buffer_io_c file{m_file, SKIM_BUFFER_SIZE, false};
+    file.enable_read_ahead(true);
+
+    result = skim_clusters_in_parallel(file, position, progress)
+          && skim_cluster_range(file, m_data, position, m_segment_end, m_segment_end, progress);
+  }
+
+  m_file->setFilePointer(position);
+
+  mxdebug_if(m_debug, strformat::bstr("skim_clusters: indexed %1% clusters, stopped at %2%\n") % (m_data.size() - num_entries) % position);
+
+  return result;
+}
+
+/** \brief Indexes consecutive clusters within a byte range
+
+    This is the core of \c skim_clusters. It only uses the arguments
+    passed in so that it can be run for several ranges of the same
+    file at the same time, each with its own file object.
+
+    Skimming stops at the first element that isn't a cluster with a
+    known size fitting into the segment or at the first cluster
+    starting at or after \c range_end. Clusters may extend beyond
+    \c range_end.
+
+    \param position Where to start skimming. Set to the position the
+      skimming stopped at on return.
+    \param progress Called whenever a new block has been read. Returns
+      \c false if the process should be aborted.
+
+    \return \c false if \c progress requested aborting and \c true
+      otherwise.
+ */
+bool
+kax_analyzer_c::skim_cluster_range(mm_io_c &file,
+                                   kax_analyzer_index_c &index,
+                                   uint64_t &position,
+                                   uint64_t range_end,
+                                   uint64_t segment_end,
+                                   std::function<bool(uint64_t)> const &progress) {
+  auto buffer        = memory_c::alloc(SKIM_BUFFER_SIZE);
+  auto buf           = buffer->get_buffer();
+  auto cluster_id    = EBML_ID_VALUE(EBML_ID(KaxCluster));
+  auto buffer_start  = position;
+  auto buffer_fill   = static_cast<uint64_t>(0);
+  auto previous_size = static_cast<uint64_t>(0);
+  auto buffering     = true;
+
+  while ((position < segment_end) && (position < range_end)) {
+    // Four bytes for the ID and at most eight bytes for the size. Less
+    // than that is only available right before the segment's end.
+    auto refill = (position < buffer_start)
+               || (   ((position + 12) > (buffer_start + buffer_fill))
+                   && ((position != buffer_start) || !buffer_fill));
+
+    if (refill) {
+      auto large_clusters = previous_size > SKIM_BUFFER_SIZE;
+      auto read_size      = std::min<uint64_t>(large_clusters ? SKIM_SMALL_BUFFER_SIZE : SKIM_BUFFER_SIZE, segment_end - position);
+
+      // Reading small blocks far apart through a read buffer would
+      // fill the whole buffer each time.
+      if (buffering == large_clusters) {
+        buffering = !large_clusters;
+        file.enable_buffering(buffering);
+      }
+
+      // The few bytes of a cluster head at the end of the buffer are
+      // kept so that consecutive blocks are read strictly sequentially.
+      auto kept = (position >= buffer_start) && (position < (buffer_start + buffer_fill)) ? buffer_start + buffer_fill - position : 0;
+      if (kept)
+        std::memmove(buf, buf + (position - buffer_start), kept);
+
+      file.setFilePointer(position + kept);
+      buffer_start = position;
+      buffer_fill  = kept + file.read(buf + kept, read_size - kept);
+
+      if (!progress(position))
+        return false;
+    }
+
+    auto head      = buf + (position - buffer_start);
+    auto available = buffer_start + buffer_fill - position;
+
+    if ((5 > available) || (get_uint32_be(head) != cluster_id))
+      break;
+
+    auto size_length = 1u;
+    while ((8 >= size_length) && !(head[4] & (0x100 >> size_length)))
+      ++size_length;
+
+    if ((8 < size_length) || ((4 + size_length) > available))
+      break;
+
+    auto size         = static_cast<uint64_t>(head[4] & (0xff >> size_length));
+    auto all_ones     = size == (0xffu >> size_length);
+
+    for (auto idx = 1u; idx < size_length; ++idx) {
+      size     = (size << 8) | head[4 + idx];
+      all_ones = all_ones && (0xff == head[4 + idx]);
+    }
+
+    auto total_size = 4 + size_length + size;
+
+    // Clusters with an unknown size are left to libEBML.
+    if (all_ones || ((position + total_size) > segment_end))
+      break;
+
+    index.push_back(EBML_ID(KaxCluster), position, total_size);
+
+    position      += total_size;
+    previous_size  = total_size;
+  }
+
+  return true;
+}
+
+/** \brief Opens the file for one range of the parallel analysis
+
+   The file is mapped if possible. Otherwise all ranges get their own
+   cursor on a single shared file descriptor so that the number of
+   open files doesn't grow with the number of threads.
+ */
+static mm_io_c *
+open_file_for_range(std::string const &file_name,
+                    mm_positional_io_cptr &shared_file,
+                    mm_io_accounting_cptr const &accounting) {
+  try {
+    return new mm_mmap_io_c(file_name);
+  } catch (mtx::mm_io::open_x &) {
+  }
+
+  std::unique_ptr<mm_read_buffer_io_c> file;
+
+  try {
+    if (!shared_file)
+      shared_file = std::make_shared<mm_positional_io_c>(file_name, MODE_READ);
+
+    file.reset(new mm_read_buffer_io_c(count_io(new mm_positional_io_c{*shared_file}, accounting)));
+
+  } catch (mtx::mm_io::open_x &) {
+    file.reset(new mm_read_buffer_io_c(count_io(new mm_file_io_c{file_name, MODE_READ}, accounting)));
+  }
+
+  file->enable_read_ahead(true);
+
+  return file.release();
+}
+
+/** \brief Skims large parts of the segment with several threads
+
+    The segment from \c position up to its end is split into byte
+    ranges. The first range is skimmed by the calling thread using the
+    analyzer's file. Each other range is skimmed by a thread of its own
+    using a separate file object. These threads first resync to the
+    first cluster within their range the same way \c kax_file_c does
+    when it encounters broken data.
+
+    The results are stitched together afterwards. A range's clusters
+    are only used if its chain of clusters starts exactly where the
+    previous range's chain ended. This way ranges that have resynced
+    to a false cluster ID inside another cluster's data are rejected.
+    Whatever hasn't been covered is left to the sequential skimmer.
+
+    This is only done once per analysis, in full parse mode and if the
+    analyzer has opened the file by name itself.
+
+    \param file The analyzer's file to skim the first range with.
+    \param position Where to start skimming. Set to the end of the
+      stitched clusters on return.
+
+    \return \c false if the user aborted the process and \c true
+      otherwise.
+ */
+bool
+kax_analyzer_c::skim_clusters_in_parallel(mm_io_c &file,
+                                          uint64_t &position,
+                                          std::function<bool(uint64_t)> const &progress) {
+  struct range_t {
+    uint64_t m_start{}, m_end{}, m_stop{};
+    bool m_ok{};
+    kax_analyzer_index_c m_index;
+    mm_io_cptr m_file;
+    std::unique_ptr<kax_file_c> m_kax_file;
+  };
+
+  if ((2 > m_num_analysis_threads) || m_parallel_analysis_attempted || !m_close_file || (position >= m_segment_end))
+    return true;
+
+  m_parallel_analysis_attempted = true;
+
+  auto num_ranges = std::min<uint64_t>(m_num_analysis_threads, (m_segment_end - position) / PARALLEL_ANALYSIS_MIN_RANGE_SIZE);
+  if (2 > num_ranges)
+    return true;
+
+  auto range_size = (m_segment_end - position) / num_ranges;
+  auto ranges     = std::vector<range_t>(num_ranges);
+
+  // Neither opening files nor the lazy registration of debugging
+  // options are thread-safe. Therefore all file objects are created
+  // and the options they query are looked up before any thread is
+  // started.
+  for (auto const &option : std::vector<std::string>{ "read_buffer_io|read_buffer_io_read", "kax_file|kax_file_read_next", "kax_file|kax_file_resync" })
+    static_cast<void>(static_cast<bool>(debugging_option_c{option}));
+
+  mm_positional_io_cptr shared_file;
+
+  for (auto idx = 0u; idx < num_ranges; ++idx) {
+    auto &range   = ranges[idx];
+    range.m_start = position + idx * range_size;
+    range.m_end   = (idx + 1) == num_ranges ? m_segment_end : range.m_start + range_size;
+
+    if (!idx)
+      continue;
+
+    range.m_file = mm_io_cptr{open_file_for_range(m_file_name, shared_file, m_io_accounting)};
+    range.m_kax_file.reset(new kax_file_c{*range.m_file});
+    range.m_kax_file->enable_reporting(false);
+    range.m_kax_file->set_segment_end(*m_segment);
+  }
+
+  auto segment_end = m_segment_end;
+  auto threads     = std::vector<std::thread>{};
+
+  mtx::at_scope_exit_c join_threads([&threads]() {
+    for (auto &thread : threads)
+      thread.join();
+  });
+
+  for (auto idx = 1u; idx < num_ranges; ++idx)
+    threads.emplace_back([&range = ranges[idx], segment_end]() {
+      try {
+        // Start one byte early so that a cluster starting exactly at
+        // the range's start is found, too.
+        range.m_file->setFilePointer(range.m_start - 1);
+
+        auto cluster = std::unique_ptr<KaxCluster>{range.m_kax_file->resync_to_cluster()};
+        if (!cluster)
+          return;
+
+        range.m_stop = cluster->GetElementPosition();
+        cluster.reset();
+
+        skim_cluster_range(*range.m_file, range.m_index, range.m_stop, range.m_end, segment_end, [](uint64_t) { return true; });
+        range.m_ok = true;
+
+      } catch (...) {
+      }
+    });
+
+  ranges[0].m_stop = position;
+  ranges[0].m_ok   = true;
+
+  if (!skim_cluster_range(file, ranges[0].m_index, ranges[0].m_stop, ranges[0].m_end, segment_end, progress))
+    return false;
+
+  for (auto &thread : threads)
+    thread.join();
+  threads.clear();
+
+  auto num_ranges_used = 0u;
+
+  for (auto &range : ranges) {
+    if (!range.m_ok)
+      break;
+
+    // Ranges completely covered by a previous range's last cluster
+    // have nothing to contribute.
+    if (range.m_stop <= position)
+      continue;
+
+    auto &index = range.m_index;
+    auto idx    = 0u;
+
+    while ((idx < index.size()) && (index.get_pos(idx) < position))
+      ++idx;
+
+    if ((idx >= index.size()) || (index.get_pos(idx) != position))
+      break;
+
+    for (; idx < index.size(); ++idx)
+      m_data.push_back(index.get_id(idx), index.get_pos(idx), index.get_size(idx), index.is_size_known(idx));
+
+    position = range.m_stop;
+    ++num_ranges_used;
+
+    if (range.m_stop < range.m_end)
+      break;
+  }
+
+  mxdebug_if(m_debug, strformat::bstr("skim_clusters_in_parallel: used %1% of %2% ranges, stopped at %3%\n") % num_ranges_used % num_ranges % position);
+
+  validate_data_structures("skim_clusters_in_parallel");
+
+  return progress(position);
+}
+
 bool
 kax_analyzer_c::process_internal() {
+  mtx::tracing::span_c span{"process_internal"};
+
   bool parse_fully = parse_mode_full == m_parse_mode;
 
   reopen_file();
@@ -285,6 +825,8 @@ kax_analyzer_c::process_internal() {
 
   m_segment.reset();
   m_data.clear();
+  invalidate_free_space();
+  m_parallel_analysis_attempted = false;
 
   m_file->setFilePointer(0);
   m_stream = new EbmlStream(*m_file);
@@ -336,6 +878,13 @@ kax_analyzer_c::process_internal() {
   if (m_parser_start_position)
     m_file->setFilePointer(std::max<uint64_t>(*m_parser_start_position, m_segment->GetElementPosition() + m_segment->HeadSize()));
 
+  // Repeated edits of the same file can skip the level 1 scan entirely
+  // if a layout cache matching the file's current state exists.
+  else if (m_use_layout_cache && load_layout_cache()) {
+    show_progress_done();
+    return true;
+  }
+
   // We've got our segment, so let's find all level 1 elements.
   while (m_file->getFilePointer() < m_segment_end) {
     if (!l1)
@@ -344,17 +893,24 @@ kax_analyzer_c::process_internal() {
     if (!l1 || (0 < upper_lvl_el))
       break;
 
-    m_data.push_back(kax_analyzer_data_c::create(EbmlId(*l1), l1->GetElementPosition(), l1->ElementSize(true), l1->IsFiniteSize()));
+    m_data.push_back(EbmlId(*l1), l1->GetElementPosition(), l1->ElementSize(true), l1->IsFiniteSize());
 
     cluster_found   |= Is<KaxCluster>(l1);
     meta_seek_found |= Is<KaxSeekHead>(l1);
 
+    auto skim = parse_fully && Is<KaxCluster>(l1) && l1->IsFiniteSize();
+
     l1->SkipData(*m_stream, EBML_CONTEXT(l1));
     delete l1;
     l1 = nullptr;
 
     aborted = !show_progress_running((int)(m_file->getFilePointer() * 100 / file_size));
 
+    // Clusters usually follow each other. Index them without creating
+    // libEBML elements for each of them.
+    if (skim && !aborted)
+      aborted = !skim_clusters(file_size);
+
     if (!in_parent(m_segment) || aborted || (cluster_found && meta_seek_found && !parse_fully))
       break;
 
@@ -374,6 +930,8 @@ kax_analyzer_c::process_internal() {
     if (parse_mode_full != m_parse_mode)
       fix_element_sizes(file_size);
 
+    m_layout_cache_needs_saving = m_use_layout_cache && !m_parser_start_position;
+
     return true;
   }
 
@@ -390,11 +948,13 @@ kax_analyzer_c::read_element(kax_analyzer_data_cptr const &element_data) {
 
 ebml_element_cptr
 kax_analyzer_c::read_element(unsigned int pos) {
-  return read_element(*m_data[pos]);
+  return read_element(kax_analyzer_data_c{m_data, pos});
 }
 
 ebml_element_cptr
 kax_analyzer_c::read_element(kax_analyzer_data_c const &element_data) {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "read_element"};
+
   reopen_file();
 
   EbmlStream es(*m_file);
@@ -409,21 +969,161 @@ kax_analyzer_c::read_element(kax_analyzer_data_c const &element_data) {
     return e;
   }
 
+  // The children are allocated in bulk. They can still be removed
+  // and deleted individually.
+  EbmlArena arena;
+  EbmlArena::Scope arena_scope{arena};
+
   upper_lvl_el_found        = 0;
   EbmlElement *upper_lvl_el = nullptr;
-  e->Read(*m_stream, EBML_INFO_CONTEXT(*callbacks), upper_lvl_el_found, upper_lvl_el, true);
+  // Payloads cannot refer to a transaction as it only lives as long
+  // as the update does.
+  auto lazy = m_lazy_payloads && !m_transaction;
+
+  e->Read(*m_stream, EBML_INFO_CONTEXT(*callbacks), upper_lvl_el_found, upper_lvl_el, true, lazy ? SCOPE_LAZY_DATA : SCOPE_ALL_DATA);
+
+  if (lazy)
+    m_lazy_elements.emplace_back(e);
 
   return e;
 }
 
-#define call_and_validate(function_call, hook_name)               \
-  function_call;                                                  \
-  debug_dump_elements_maybe(hook_name);                           \
-  validate_data_structures(hook_name);                            \
-  if (analyzer_debugging_requested("verify"))                     \
-    verify_data_structures_against_file(hook_name);               \
-  if (debugging_c::requested("kax_analyzer_" hook_name "_break")) \
-    return uer_success;
+namespace {
+
+// The debugging options of the hooks between the steps of an update
+// are looked up once per hook instead of each time it is passed.
+struct analyzer_hook_t {
+  debugging_option_c m_dump, m_break;
+
+  analyzer_hook_t(char const *name)
+    : m_dump{std::string{"kax_analyzer|kax_analyzer_"} + name}
+    , m_break{std::string{"kax_analyzer_"} + name + "_break"}
+  {
+  }
+};
+
+}
+
+namespace {
+
+using file_ranges_t = std::vector<std::pair<uint64_t, uint64_t>>;
+
+void
+load_payloads(EbmlElement &e,
+              file_ranges_t const &ranges) {
+  auto binary = dynamic_cast<EbmlBinary *>(&e);
+  if (binary) {
+    if (!binary->IsLazy())
+      return;
+
+    auto start = binary->GetSourcePosition();
+    auto end   = start + binary->GetSize();
+
+    if (std::any_of(ranges.begin(), ranges.end(), [start, end](std::pair<uint64_t, uint64_t> const &range) { return (start < range.second) && (end > range.first); }))
+      binary->Load();
+    return;
+  }
+
+  auto master = dynamic_cast<EbmlMaster const *>(&e);
+  if (master)
+    for (auto child : *master)
+      load_payloads(*child, ranges);
+}
+
+bool
+has_lazy_payloads(EbmlElement const &e) {
+  auto binary = dynamic_cast<EbmlBinary const *>(&e);
+  if (binary)
+    return binary->IsLazy();
+
+  auto master = dynamic_cast<EbmlMaster const *>(&e);
+  return master && std::any_of(master->begin(), master->end(), [](EbmlElement const *child) { return has_lazy_payloads(*child); });
+}
+
+}
+
+/** \brief Reads all payloads still referring to the file
+
+   Elements that have been read with lazy payloads and that are still
+   alive are traversed and their payloads read into memory.
+ */
+void
+kax_analyzer_c::load_lazy_payloads() {
+  load_lazy_payloads(file_ranges_t{ { 0, std::numeric_limits<uint64_t>::max() } });
+  m_lazy_elements.clear();
+}
+
+/** \brief Reads the lazily read payloads located in a range of the file
+
+   Must be called before the bytes from \c start up to \c end are
+   overwritten or moved. Payloads elsewhere keep referring to the file.
+
+   Inside a transaction nothing is read as the file itself only
+   changes once the transaction is committed. The ranges committing
+   changes are read right before that instead.
+ */
+void
+kax_analyzer_c::load_lazy_payloads(uint64_t start,
+                                   uint64_t end) {
+  if (!m_transaction)
+    load_lazy_payloads(file_ranges_t{ { start, end } });
+}
+
+void
+kax_analyzer_c::load_lazy_payloads(std::vector<std::pair<uint64_t, uint64_t>> const &ranges) {
+  if (m_lazy_elements.empty() || ranges.empty())
+    return;
+
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "load_lazy_payloads"};
+
+  brng::remove_erase_if(m_lazy_elements, [](std::weak_ptr<EbmlElement> const &element) { return element.expired(); });
+
+  for (auto const &weak_element : m_lazy_elements) {
+    auto element = weak_element.lock();
+    if (element)
+      load_payloads(*element, ranges);
+  }
+}
+
+/** \brief Reads only the ID and the size of a level 1 element
+
+    The returned element carries its position, head size and content
+    size, but none of its content. This is enough for updating its
+    head or indexing it in a meta seek element without reading
+    arbitrarily large elements into memory.
+ */
+ebml_element_cptr
+kax_analyzer_c::read_element_head(size_t data_idx) {
+  reopen_file();
+
+  EbmlStream es(*m_file);
+  m_file->setFilePointer(m_data.get_pos(data_idx));
+
+  int upper_lvl_el_found         = 0;
+  ebml_element_cptr e            = ebml_element_cptr(es.FindNextElement(EBML_CONTEXT(m_segment), upper_lvl_el_found, 0xFFFFFFFFL, true, 1));
+  const EbmlCallbacks *callbacks = find_ebml_callbacks(EBML_INFO(KaxSegment), m_data.get_id(data_idx));
+
+  if (!e || !callbacks || (EbmlId(*e) != EBML_INFO_ID(*callbacks)))
+    e.reset();
+
+  return e;
+}
+
+#define call_and_validate(function_call, hook_name)             \
+  {                                                             \
+    static analyzer_hook_t const s_hook{hook_name};             \
+    {                                                           \
+      mtx::tracing::span_c span{hook_name};                     \
+      function_call;                                            \
+    }                                                           \
+    if (s_hook.m_dump)                                          \
+      debug_dump_elements_maybe(hook_name);                     \
+    validate_data_structures(hook_name);                        \
+    if (m_debug_verify)                                         \
+      verify_data_structures_against_file(hook_name);           \
+    if (s_hook.m_break)                                         \
+      return uer_success;                                       \
+  }
 
 kax_analyzer_c::update_element_result_e
 kax_analyzer_c::update_element(ebml_element_cptr const &e,
@@ -443,26 +1143,278 @@ kax_analyzer_c::update_element(EbmlElement *e,
       fix_mandatory_elements(e);
     remove_voids_from_master(e);
 
+    auto patched = false;
+    call_and_validate(patched = patch_element_in_place(e, write_defaults), "update_element_patch");
+
+    if (patched) {
+      flush_file();
+      m_layout_cache_needs_saving = m_use_layout_cache;
+      return uer_success;
+    }
+
     placement_strategy_e strategy = get_placement_strategy_for(e);
 
     call_and_validate({},                                         "update_element_0");
     call_and_validate(fix_unknown_size_for_last_level1_element(), "update_element_0_1");
-    call_and_validate(overwrite_all_instances(EbmlId(*e)),        "update_element_1");
-    call_and_validate(merge_void_elements(),                      "update_element_2");
-    call_and_validate(write_element(e, write_defaults, strategy), "update_element_3");
-    call_and_validate(remove_from_meta_seeks(EbmlId(*e)),         "update_element_4");
+
+    if (has_lazy_payloads(*e) && can_write_before_overwriting(e, write_defaults)) {
+      // Payloads still located in an old instance are copied from
+      // there while writing the new one. Overwriting the old instance
+      // first would require reading them into memory.
+      m_previous_positions.clear();
+
+      call_and_validate(merge_void_elements(),                                              "update_element_moved_1");
+      call_and_validate(write_element(e, write_defaults, strategy),                         "update_element_moved_2");
+      call_and_validate(overwrite_all_instances({ EbmlId(*e) }, e->GetElementPosition()), "update_element_moved_3");
+
+    } else {
+      call_and_validate(overwrite_all_instances({ EbmlId(*e) }),    "update_element_1");
+      call_and_validate(merge_void_elements(),                      "update_element_2");
+      call_and_validate(write_element(e, write_defaults, strategy), "update_element_3");
+    }
+
+    call_and_validate(remove_from_meta_seeks({ EbmlId(*e) }),     "update_element_4");
     call_and_validate(merge_void_elements(),                      "update_element_5");
-    call_and_validate(add_to_meta_seek(e),                        "update_element_6");
+    call_and_validate(add_to_meta_seek({ e }),                    "update_element_6");
     call_and_validate(merge_void_elements(),                      "update_element_7");
 
+    flush_file();
+
   } catch (kax_analyzer_c::update_element_result_e result) {
     debug_dump_elements_maybe("update_element_exception");
+    m_layout_cache_invalid = m_use_layout_cache;
+    return result;
+
+  } catch (mtx::mm_io::exception &ex) {
+    mxdebug_if(m_debug, strformat::bstr("I/O exception: %1%\n") % ex.what());
+    m_layout_cache_invalid = m_use_layout_cache;
+    return uer_error_unknown;
+  }
+
+  m_layout_cache_needs_saving = m_use_layout_cache;
+
+  return uer_success;
+}
+
+/** \brief Updates several level 1 elements in a single pass
+
+    All requests are planned together: each step of the update is run
+    only once for all of them, e.g. each meta seek element is read and
+    rewritten at most twice regardless of the number of requests. The
+    planned changes are kept in memory (see \c mm_transaction_io_c).
+    Only once all requests have been planned successfully are they
+    written to the file in the order of their positions, followed by at
+    most one truncation. If any request fails then neither the file nor
+    the analyzer's data structures are changed.
+
+    Changes requiring more than \c MAX_TRANSACTION_SIZE bytes of
+    memory, e.g. rewriting large attachments, cannot be planned like
+    this. Then the requests are processed one after the other as if
+    \c update_element() or \c remove_elements() had been called for
+    each of them. A failure leaves the earlier requests written in
+    that case.
+
+    \param requests The elements to write. Requests whose \c m_remove
+      member is set only remove all instances of their element's ID
+      from the file.
+    \param failed_element If given and the update fails then it is set
+      to the element that was being processed when the error occurred.
+      It is set to \c nullptr if the error cannot be attributed to a
+      single element.
+ */
+kax_analyzer_c::update_element_result_e
+kax_analyzer_c::update_elements(std::vector<update_request_t> const &requests,
+                                EbmlElement **failed_element) {
+  EbmlElement *current_element = nullptr;
+
+  if (failed_element)
+    *failed_element = nullptr;
+
+  if (requests.empty())
+    return uer_success;
+
+  try {
+    reopen_file_for_writing();
+
+    for (auto const &request : requests) {
+      if (request.m_remove)
+        continue;
+
+      if (request.m_add_mandatory_elements_if_missing)
+        fix_mandatory_elements(request.m_element);
+      remove_voids_from_master(request.m_element);
+    }
+
+    update_element_result_e result;
+
+    try {
+      result = update_elements_in_transaction(requests, current_element);
+
+    } catch (mtx::mm_io::transaction_too_large_x &) {
+      mxdebug_if(m_debug, "update_elements: too much data for a single transaction; updating one element after the other\n");
+      result = update_elements_one_by_one(requests, current_element);
+    }
+
+    if (uer_success != result) {
+      if (failed_element)
+        *failed_element = current_element;
+      return result;
+    }
+
+    flush_file();
+
+    m_layout_cache_needs_saving = m_use_layout_cache;
+
+    return uer_success;
+
+  } catch (kax_analyzer_c::update_element_result_e result) {
+    debug_dump_elements_maybe("update_elements_exception");
+    m_layout_cache_invalid = m_use_layout_cache;
+
+    if (failed_element)
+      *failed_element = current_element;
+
     return result;
 
   } catch (mtx::mm_io::exception &ex) {
     mxdebug_if(m_debug, strformat::bstr("I/O exception: %1%\n") % ex.what());
+    m_layout_cache_invalid = m_use_layout_cache;
+
+    if (failed_element)
+      *failed_element = current_element;
+
     return uer_error_unknown;
   }
+}
+
+/** \brief Plans all requests in memory and commits them if successful
+
+    The file and the stream used for reading elements are replaced by
+    a transaction on top of them for the duration of the planning. If
+    planning fails for any reason then the transaction is rolled back,
+    and the data structures describing the file are restored.
+ */
+kax_analyzer_c::update_element_result_e
+kax_analyzer_c::update_elements_in_transaction(std::vector<update_request_t> const &requests,
+                                               EbmlElement *&current_element) {
+  auto file               = m_file;
+  auto stream             = m_stream;
+  auto data               = m_data;
+  auto segment            = m_segment;
+  auto segment_end        = m_segment_end;
+  auto meta_seeks         = m_meta_seeks_by_position;
+  auto previous_positions = m_previous_positions;
+  auto statistics         = m_placement_statistics;
+
+  mm_transaction_io_c transaction{m_file, MAX_TRANSACTION_SIZE};
+  EbmlStream transaction_stream{transaction};
+
+  m_file        = &transaction;
+  m_stream      = &transaction_stream;
+  m_transaction = &transaction;
+
+  mtx::at_scope_exit_c restore_file([this, file, stream]() {
+    m_file        = file;
+    m_stream      = stream;
+    m_transaction = nullptr;
+  });
+
+  try {
+    auto result = update_elements_internal(requests, current_element);
+
+    load_lazy_payloads(transaction.get_changed_ranges());
+
+    mm_io_accounting_c::phase_c io_phase{m_io_accounting, "flush"};
+    transaction.commit();
+
+    return result;
+
+  } catch (...) {
+    transaction.rollback();
+
+    m_data                   = std::move(data);
+    m_segment                = segment;
+    m_segment_end            = segment_end;
+    m_meta_seeks_by_position = std::move(meta_seeks);
+    m_previous_positions     = std::move(previous_positions);
+    m_placement_statistics   = statistics;
+    invalidate_free_space();
+
+    throw;
+  }
+}
+
+kax_analyzer_c::update_element_result_e
+kax_analyzer_c::update_elements_internal(std::vector<update_request_t> const &requests,
+                                         EbmlElement *&current_element) {
+  std::vector<EbmlId> ids;
+  std::vector<update_request_t const *> requests_to_write;
+
+  for (auto const &request : requests) {
+    if (!request.m_remove) {
+      // Elements whose size hasn't changed don't have to go through
+      // the whole process.
+      current_element = request.m_element;
+      auto patched    = false;
+      call_and_validate(patched = patch_element_in_place(request.m_element, request.m_write_defaults), "update_elements_patch");
+
+      if (patched)
+        continue;
+
+      requests_to_write.push_back(&request);
+    }
+
+    ids.emplace_back(*request.m_element);
+  }
+
+  current_element = nullptr;
+
+  if (ids.empty())
+    return uer_success;
+
+  call_and_validate({},                                         "update_elements_0");
+  call_and_validate(fix_unknown_size_for_last_level1_element(), "update_elements_1");
+  call_and_validate(overwrite_all_instances(ids),               "update_elements_2");
+  call_and_validate(merge_void_elements(),                      "update_elements_3");
+
+  std::vector<EbmlElement *> elements_to_write;
+
+  for (auto request : requests_to_write) {
+    current_element = request->m_element;
+    elements_to_write.push_back(request->m_element);
+
+    auto strategy = get_placement_strategy_for(request->m_element);
+    call_and_validate(write_element(request->m_element, request->m_write_defaults, strategy), "update_elements_3_1");
+  }
+
+  current_element = nullptr;
+
+  call_and_validate({},                                         "update_elements_4");
+  call_and_validate(remove_from_meta_seeks(ids),                "update_elements_5");
+  call_and_validate(merge_void_elements(),                      "update_elements_6");
+
+  if (!elements_to_write.empty()) {
+    call_and_validate(add_to_meta_seek(elements_to_write),      "update_elements_7");
+    call_and_validate(merge_void_elements(),                    "update_elements_8");
+  }
+
+  return uer_success;
+}
+
+kax_analyzer_c::update_element_result_e
+kax_analyzer_c::update_elements_one_by_one(std::vector<update_request_t> const &requests,
+                                           EbmlElement *&current_element) {
+  for (auto const &request : requests) {
+    current_element = request.m_element;
+
+    auto result = request.m_remove ? remove_elements(EbmlId(*request.m_element))
+                :                    update_element(request.m_element, request.m_write_defaults, false);
+
+    if (uer_success != result)
+      return result;
+  }
+
+  current_element = nullptr;
 
   return uer_success;
 }
@@ -474,16 +1426,21 @@ kax_analyzer_c::remove_elements(EbmlId const &id) {
 
     call_and_validate({},                                         "remove_elements_0");
     call_and_validate(fix_unknown_size_for_last_level1_element(), "remove_elements_1");
-    call_and_validate(overwrite_all_instances(id),                "remove_elements_2");
+    call_and_validate(overwrite_all_instances({ id }),            "remove_elements_2");
     call_and_validate(merge_void_elements(),                      "remove_elements_3");
-    call_and_validate(remove_from_meta_seeks(id),                 "remove_elements_4");
+    call_and_validate(remove_from_meta_seeks({ id }),             "remove_elements_4");
     call_and_validate(merge_void_elements(),                      "remove_elements_5");
 
+    flush_file();
+
   } catch (kax_analyzer_c::update_element_result_e result) {
     debug_dump_elements_maybe("update_element_exception");
+    m_layout_cache_invalid = m_use_layout_cache;
     return result;
   }
 
+  m_layout_cache_needs_saving = m_use_layout_cache;
+
   return uer_success;
 }
 
@@ -491,6 +1448,8 @@ kax_analyzer_c::remove_elements(EbmlId const &id) {
  */
 void
 kax_analyzer_c::adjust_segment_size() {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "segment_size"};
+
   // If the old segment's size is unknown then don't try to force a
   // finite size as this will fail most of the time: an
   // infinite/unknown size is coded by the value 0 which is often
@@ -529,6 +1488,14 @@ kax_analyzer_c::adjust_segment_size() {
     file stays compatible with all parsers, and only a small number of
     bytes have to be moved around.
 
+    If the following element's size field is already eight bytes long
+    then its head is rewritten one byte further back with a seven-byte
+    size field instead, leaving room for an empty EbmlVoid element
+    (see \c shrink_size_field_of_next_element()). Where that isn't
+    possible the previous element's content is moved one byte to the
+    back and its size field is extended by one byte (see
+    \c move_element_content_back_by_one_byte()).
+
     The \c m_data member structure is also updated to reflect the
     changes made to the file.
 
@@ -551,29 +1518,35 @@ kax_analyzer_c::handle_void_elements(size_t data_idx) {
   // and remove the element from the data structure if that was
   // requested. Then we're done.
   if (m_data.size() == (data_idx + 1)) {
-    m_file->truncate(m_data[data_idx]->m_pos + m_data[data_idx]->m_size);
+    m_file->truncate(m_data.get_pos(data_idx) + m_data.get_size(data_idx));
     adjust_segment_size();
-    if (0 == m_data[data_idx]->m_size)
-      m_data.erase(m_data.begin() + data_idx);
+    if (0 == m_data.get_size(data_idx)) {
+      free_space_removed(data_idx);
+      m_data.erase(data_idx);
+    }
     return false;
   }
 
   // Are the following elements EbmlVoid elements?
   size_t end_idx = data_idx + 1;
-  while ((m_data.size() > end_idx) && Is<EbmlVoid>(m_data[end_idx]->m_id))
+  while ((m_data.size() > end_idx) && Is<EbmlVoid>(m_data.get_id(end_idx)))
     ++end_idx;
 
-  if (end_idx > data_idx + 1)
+  if (end_idx > data_idx + 1) {
     // Yes, there is at least one. Remove these elements from the list
     // in order to create a new EbmlVoid element covering their space
     // as well.
-    m_data.erase(m_data.begin() + data_idx + 1, m_data.begin() + end_idx);
+    for (auto void_idx = data_idx + 1; void_idx < end_idx; ++void_idx)
+      free_space_removed(void_idx);
+
+    m_data.erase(data_idx + 1, end_idx);
+  }
 
   // Calculate how much space we have to cover with a void
   // element. This is the difference between the next element's
   // position and the current element's end.
-  int64_t void_pos = m_data[data_idx]->m_pos + m_data[data_idx]->m_size;
-  int void_size    = m_data[data_idx + 1]->m_pos - void_pos;
+  int64_t void_pos = m_data.get_pos(data_idx) + m_data.get_size(data_idx);
+  int void_size    = m_data.get_pos(data_idx + 1) - void_pos;
 
   // If the difference is 0 then we have nothing to do.
   if (0 == void_size)
@@ -586,9 +1559,10 @@ kax_analyzer_c::handle_void_elements(size_t data_idx) {
     // No. The most compatible way to deal with this situation is to
     // move the element ID of the following element one byte to the
     // front and extend the following element's size field by one
-    // byte.
+    // byte. Only the element's head is needed for that; its content
+    // isn't touched.
 
-    ebml_element_cptr e = read_element(m_data[data_idx + 1]);
+    ebml_element_cptr e = read_element_head(data_idx + 1);
 
     if (!e)
       return false;
@@ -596,44 +1570,15 @@ kax_analyzer_c::handle_void_elements(size_t data_idx) {
     // However, this might not work if the element's size was already
     // eight bytes long.
     if (8 == e->GetSizeLength()) {
-      // In this case try doing the same with the previous
-      // element. The whole element has be moved one byte to the back.
-      e = read_element(m_data[data_idx]);
-      if (!e)
-        return false;
-
-      std::shared_ptr<EbmlElement> af_e(e);
-
-      // Again the test for maximum size length.
-      if (8 == e->GetSizeLength())
-        return false;
-
-      // Copy the content one byte to the back.
-      unsigned int id_length = EBML_ID_LENGTH(static_cast<const EbmlId &>(*e));
-      uint64_t content_pos   = m_data[data_idx]->m_pos + id_length + e->GetSizeLength();
-      uint64_t content_size  = m_data[data_idx + 1]->m_pos - content_pos - 1;
-      memory_cptr buffer     = memory_c::alloc(content_size);
-
-      m_file->setFilePointer(content_pos);
-      if (m_file->read(buffer, content_size) != content_size)
-        return false;
-
-      m_file->setFilePointer(content_pos + 1);
-      if (m_file->write(buffer) != content_size)
-        return false;
-
-      // Prepare the new codec size and write it.
-      binary head[8];           // Class D + 64 bits coded size
-      int coded_size = CodedSizeLength(content_size, e->GetSizeLength() + 1, true);
-      CodedValueLength(content_size, coded_size, head);
-      m_file->setFilePointer(m_data[data_idx]->m_pos + id_length);
-      if (m_file->write(head, coded_size) != static_cast<unsigned int>(coded_size))
-        return false;
-
-      // Update internal structures.
-      m_data[data_idx]->m_size += 1;
-
-      return true;
+      // Shortening the size field to seven bytes instead moves the
+      // element's head one byte to the back. The gap grows to two
+      // bytes which is just enough for an empty EbmlVoid element.
+      if (shrink_size_field_of_next_element(data_idx, *e))
+        return true;
+
+      // Otherwise try doing the same with the previous element. The
+      // whole element has be moved one byte to the back.
+      return move_element_content_back_by_one_byte(data_idx);
     }
 
     binary head[4 + 8];         // Class D + 64 bits coded size
@@ -644,19 +1589,14 @@ kax_analyzer_c::handle_void_elements(size_t data_idx) {
     CodedValueLength(e->GetSize(), coded_size, &head[head_size]);
     head_size += coded_size;
 
-    m_file->setFilePointer(m_data[data_idx + 1]->m_pos - 1);
+    m_file->setFilePointer(m_data.get_pos(data_idx + 1) - 1);
     m_file->write(head, head_size);
 
-    --m_data[data_idx + 1]->m_pos;
-    ++m_data[data_idx + 1]->m_size;
+    m_data.set_pos(data_idx + 1,  m_data.get_pos(data_idx + 1) - 1);
+    m_data.set_size(data_idx + 1, m_data.get_size(data_idx + 1) + 1);
 
     // Update meta seek indices for m_data[data_idx]'s new position.
-    e = read_element(m_data[data_idx + 1]);
-
-    remove_from_meta_seeks(EbmlId(*e));
-    merge_void_elements();
-    add_to_meta_seek(e.get());
-    merge_void_elements();
+    update_meta_seeks_for_moved_element(data_idx + 1);
 
     return false;
   }
@@ -713,35 +1653,279 @@ kax_analyzer_c::handle_void_elements(size_t data_idx) {
 
   evoid.Render(*m_file);
 
-  m_data.insert(m_data.begin() + data_idx + 1, kax_analyzer_data_c::create(EBML_ID(EbmlVoid), void_pos, void_size));
+  // Both the current element (if it is to be replaced) and the new
+  // void element may start at the same position. Drop the former from
+  // the free space map first.
+  if (0 == m_data.get_size(data_idx))
+    free_space_removed(data_idx);
+
+  m_data.insert(data_idx + 1, EBML_ID(EbmlVoid), void_pos, void_size);
+  free_space_added(data_idx + 1);
 
   // Now check if we should overwrite the current element with the
   // EbmlVoid element. That is the case if the current element's size
   // is 0. In that case simply remove the element from the data
   // vector.
-  if (0 == m_data[data_idx]->m_size)
-    m_data.erase(m_data.begin() + data_idx);
+  if (0 == m_data.get_size(data_idx))
+    m_data.erase(data_idx);
+
+  return true;
+}
+
+/** \brief Turns a one-byte gap into an EbmlVoid element
+
+    The element following the gap has an eight-byte size field. Its
+    head is rewritten one byte further back with a seven-byte size
+    field, leaving two bytes at the gap's position for an empty
+    EbmlVoid element. The element's content stays where it is.
+
+    \param data_idx Index of the element in front of the gap.
+    \param next_head The head of the element following the gap.
+
+    \return \c false if the element's size doesn't fit into seven
+      bytes or if the element is a cluster. Clusters must not move as
+      the cues refer to their positions. Nothing has been changed in
+      that case.
+ */
+bool
+kax_analyzer_c::shrink_size_field_of_next_element(size_t data_idx,
+                                                  EbmlElement &next_head) {
+  auto next_idx = data_idx + 1;
+  auto size     = next_head.GetSize();
+
+  if (Is<KaxCluster>(m_data.get_id(next_idx)) || !m_data.is_size_known(next_idx) || (7 != CodedSizeLength(size, 7, true)))
+    return false;
+
+  binary head[4 + 7];           // Class D + 56 bits coded size
+  unsigned int head_size = EBML_ID_LENGTH(static_cast<const EbmlId &>(next_head));
+  EbmlId(next_head).Fill(head);
+  CodedValueLength(size, 7, &head[head_size]);
+  head_size += 7;
+
+  auto void_pos = m_data.get_pos(next_idx) - 1;
+
+  m_file->setFilePointer(void_pos + 2);
+  if (m_file->write(head, head_size) != head_size)
+    return false;
+
+  EbmlVoid evoid;
+  evoid.SetSize(0);
+  m_file->setFilePointer(void_pos);
+  evoid.Render(*m_file);
+
+  m_data.set_pos(next_idx,  void_pos + 2);
+  m_data.set_size(next_idx, m_data.get_size(next_idx) - 1);
+
+  m_data.insert(next_idx, EBML_ID(EbmlVoid), void_pos, 2);
+  free_space_added(next_idx);
+
+  mxdebug_if(m_debug, strformat::bstr("shrink_size_field_of_next_element: %1% now at %2%\n") % kax_analyzer_data_c(m_data, next_idx + 1).to_string() % (void_pos + 2));
+
+  update_meta_seeks_for_moved_element(next_idx + 1);
+
+  return true;
+}
+
+/** \brief Closes a one-byte gap by moving an element's content
+
+    The size field of the element in front of the gap is extended by
+    one byte, and its content is moved one byte to the back. The
+    content is copied in blocks of a fixed size so that memory usage
+    doesn't depend on the element's size.
+
+    \param data_idx Index of the element in front of the gap.
+
+    \return \c true if the gap has been closed.
+ */
+bool
+kax_analyzer_c::move_element_content_back_by_one_byte(size_t data_idx) {
+  auto e = read_element_head(data_idx);
+  if (!e)
+    return false;
+
+  // Again the test for maximum size length.
+  if (8 == e->GetSizeLength())
+    return false;
+
+  unsigned int id_length = EBML_ID_LENGTH(static_cast<const EbmlId &>(*e));
+  uint64_t content_pos   = m_data.get_pos(data_idx) + id_length + e->GetSizeLength();
+  uint64_t content_size  = m_data.get_pos(data_idx + 1) - content_pos - 1;
+
+  load_lazy_payloads(content_pos, content_pos + content_size);
+
+  if (!copy_file_data(content_pos, content_pos + 1, content_size))
+    return false;
+
+  // Prepare the new codec size and write it.
+  binary head[8];               // Class D + 64 bits coded size
+  int coded_size = CodedSizeLength(content_size, e->GetSizeLength() + 1, true);
+  CodedValueLength(content_size, coded_size, head);
+  m_file->setFilePointer(m_data.get_pos(data_idx) + id_length);
+  if (m_file->write(head, coded_size) != static_cast<unsigned int>(coded_size))
+    return false;
+
+  // Update internal structures.
+  free_space_removed(data_idx);
+  m_data.set_size(data_idx, m_data.get_size(data_idx) + 1);
+  free_space_added(data_idx);
+
+  return true;
+}
+
+/** \brief Copies a range of bytes within the file
+
+    A buffer of a fixed size is used regardless of the amount of data.
+    Overlapping ranges are copied back to front if the destination
+    lies behind the source so that no data is overwritten before it
+    has been copied.
+ */
+bool
+kax_analyzer_c::copy_file_data(uint64_t source_pos,
+                               uint64_t destination_pos,
+                               uint64_t size) {
+  auto buffer    = memory_c::alloc(std::min<uint64_t>(std::max<uint64_t>(size, 1), COPY_BUFFER_SIZE));
+  auto backwards = (destination_pos > source_pos) && (destination_pos < (source_pos + size));
+  auto copied    = uint64_t{};
+
+  while (copied < size) {
+    auto chunk_size = std::min<uint64_t>(size - copied, buffer->get_size());
+    auto offset     = backwards ? size - copied - chunk_size : copied;
+
+    m_file->setFilePointer(source_pos + offset);
+    if (m_file->read(buffer, chunk_size) != chunk_size)
+      return false;
+
+    m_file->setFilePointer(destination_pos + offset);
+    if (m_file->write(buffer, chunk_size) != chunk_size)
+      return false;
+
+    copied += chunk_size;
+  }
+
+  return true;
+}
+
+/** \brief Updates the meta seek entries of an element that has been moved
+ */
+void
+kax_analyzer_c::update_meta_seeks_for_moved_element(size_t data_idx) {
+  auto e = read_element_head(data_idx);
+  if (!e)
+    return;
+
+  remove_from_meta_seeks({ EbmlId(*e) });
+  merge_void_elements();
+  add_to_meta_seek({ e.get() });
+  merge_void_elements();
+}
+
+/** \brief Returns the map of free space, rebuilding it if necessary
+
+    The map is kept in sync with the EbmlVoid elements in \c m_data by
+    all functions that create, resize or overwrite such elements. It
+    is only rebuilt from scratch after the level 1 elements have been
+    read anew or after changes that are too rare to bother tracking.
+ */
+kax_analyzer_free_space_c &
+kax_analyzer_c::get_free_space() {
+  if (m_free_space_valid)
+    return m_free_space;
+
+  auto first_cluster_idx = m_data.find(EBML_ID(KaxCluster));
+  m_free_space.reset(-1 != first_cluster_idx ? m_data.get_pos(first_cluster_idx) : std::numeric_limits<uint64_t>::max());
+
+  for (auto data_idx : m_data.find_all(EBML_ID(EbmlVoid)))
+    m_free_space.add(m_data.get_pos(data_idx), m_data.get_size(data_idx));
+
+  m_free_space_valid = true;
+
+  return m_free_space;
+}
+
+void
+kax_analyzer_c::invalidate_free_space() {
+  m_free_space_valid = false;
+}
+
+void
+kax_analyzer_c::free_space_added(size_t data_idx) {
+  if (m_free_space_valid && Is<EbmlVoid>(m_data.get_id(data_idx)))
+    m_free_space.add(m_data.get_pos(data_idx), m_data.get_size(data_idx));
+}
+
+void
+kax_analyzer_c::free_space_removed(size_t data_idx) {
+  if (m_free_space_valid && Is<EbmlVoid>(m_data.get_id(data_idx)))
+    m_free_space.remove(m_data.get_pos(data_idx));
+}
+
+/** \brief Finds the EbmlVoid element at the position an element was
+    located at before it was overwritten
+
+    \return The index into \c m_data of the EbmlVoid element starting
+      where the first instance of \c id overwritten by \c
+      overwrite_all_instances started or nothing if there is no such
+      element or if it is too small to hold \c size bytes.
+ */
+mbalgm::optional<size_t>
+kax_analyzer_c::find_free_space_at_previous_position(EbmlId const &id,
+                                                     int64_t size) {
+  auto itr = m_previous_positions.find(EBML_ID_VALUE(id));
+  if (itr == m_previous_positions.end())
+    return {};
+
+  auto data_idx = m_data.find_by_position(itr->second);
+  if ((-1 == data_idx) || !Is<EbmlVoid>(m_data.get_id(data_idx)) || (m_data.get_size(data_idx) < size))
+    return {};
+
+  return static_cast<size_t>(data_idx);
+}
+
+/** \brief Finds the best EbmlVoid element to hold \c size bytes
+
+    \return The index into \c m_data of the EbmlVoid element to
+      overwrite or nothing if there is none large enough.
+ */
+mbalgm::optional<size_t>
+kax_analyzer_c::find_free_space(int64_t size,
+                                kax_analyzer_free_space_c::region_e region,
+                                bool allow_one_byte_remainder) {
+  auto position = get_free_space().find(size, region, allow_one_byte_remainder);
+  if (!position)
+    return {};
+
+  auto data_idx = m_data.find_by_position(*position);
+  if (-1 != data_idx)
+    while ((m_data.size() > static_cast<size_t>(data_idx)) && (m_data.get_pos(data_idx) == *position) && !Is<EbmlVoid>(m_data.get_id(data_idx)))
+      ++data_idx;
+
+  if ((-1 == data_idx) || (m_data.size() <= static_cast<size_t>(data_idx)) || (m_data.get_pos(data_idx) != *position)) {
+    mxdebug_if(m_debug, strformat::bstr("find_free_space: no void element at position %1%\n") % *position);
+    throw uer_error_unknown;
+  }
 
-  return true;
+  return static_cast<size_t>(data_idx);
 }
 
-/** \brief Removes all seek entries for a specific element
+/** \brief Removes all seek entries for specific elements
 
     Iterates over the level 1 elements in the file and reads each seek
-    head it finds. All entries for the given \c id are removed from
+    head it finds. All entries for the given \c ids are removed from
     the seek head. If the seek head has been changed then it is
     rewritten to its original position. The space freed up is filled
     with a new EbmlVoid element.
 
-    \param id The ID of the elements that should be removed.
+    \param ids The IDs of the elements whose entries should be removed.
  */
 void
-kax_analyzer_c::remove_from_meta_seeks(EbmlId id) {
+kax_analyzer_c::remove_from_meta_seeks(std::vector<EbmlId> const &ids) {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "meta_seek"};
+
   size_t data_idx;
 
   for (data_idx = 0; m_data.size() > data_idx; ++data_idx) {
     // We only have to do work on SeekHead elements. Skip the others.
-    if (!Is<KaxSeekHead>(m_data[data_idx]->m_id))
+    if (!Is<KaxSeekHead>(m_data.get_id(data_idx)))
       continue;
 
     // Read the element from the file. Remember its size so that a new
@@ -764,7 +1948,7 @@ kax_analyzer_c::remove_from_meta_seeks(EbmlId id) {
 
       KaxSeek *seek_entry = dynamic_cast<KaxSeek *>((*seek_head)[sh_idx]);
 
-      if (!seek_entry->IsEbmlId(id)) {
+      if (std::none_of(ids.begin(), ids.end(), [seek_entry](EbmlId const &id) { return seek_entry->IsEbmlId(id); })) {
         ++sh_idx;
         continue;
       }
@@ -782,7 +1966,7 @@ kax_analyzer_c::remove_from_meta_seeks(EbmlId id) {
     // If the seek head is now empty then simply remove and overwrite
     // it with a void element.
     if (0 == seek_head->ListSize()) {
-      m_data[data_idx]->m_size = 0;
+      m_data.set_size(data_idx, 0);
       handle_void_elements(data_idx);
 
       continue;
@@ -796,39 +1980,95 @@ kax_analyzer_c::remove_from_meta_seeks(EbmlId id) {
       throw uer_error_unknown;
 
     // Overwrite the element itself and update its internal record.
-    m_file->setFilePointer(m_data[data_idx]->m_pos);
+    m_file->setFilePointer(m_data.get_pos(data_idx));
     seek_head->Render(*m_file, true);
 
-    m_data[data_idx]->m_size = new_size;
+    m_data.set_size(data_idx, new_size);
 
     // Create a void element to cover the freed space.
     handle_void_elements(data_idx);
   }
 }
 
-/** \brief Overwrites all instances of a specific level 1 element
+/** \brief Overwrites all instances of specific level 1 elements
 
     Iterates over the level 1 elements in the file and overwrites
-    each instance of a specific level 1 element given by \c id.
-    It is replaced with a new EbmlVoid element.
+    each instance of the level 1 elements given by \c ids.
+    They are replaced with new EbmlVoid elements.
 
-    \param id The ID of the elements that should be overwritten.
+    \param ids The IDs of the elements that should be overwritten.
+    \param position_to_keep If given then the instance located there
+      is kept, e.g. because it is the new version of the element that
+      has already been written.
  */
 void
-kax_analyzer_c::overwrite_all_instances(EbmlId id) {
+kax_analyzer_c::overwrite_all_instances(std::vector<EbmlId> const &ids,
+                                        mbalgm::optional<uint64_t> const &position_to_keep) {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "overwrite_all_instances"};
+
   size_t data_idx;
 
+  m_previous_positions.clear();
+
   for (data_idx = 0; m_data.size() > data_idx; ++data_idx) {
     // We only have to do work on specific elements. Skip the others.
-    if (m_data[data_idx]->m_id != id)
+    if (std::find(ids.begin(), ids.end(), m_data.get_id(data_idx)) == ids.end())
+      continue;
+
+    if (position_to_keep && (*position_to_keep == m_data.get_pos(data_idx)))
       continue;
 
+    // Remember where the first instance was so that write_element()
+    // can put the new version at the same spot.
+    m_previous_positions.emplace(EBML_ID_VALUE(m_data.get_id(data_idx)), m_data.get_pos(data_idx));
+
+    load_lazy_payloads(m_data.get_pos(data_idx), m_data.get_pos(data_idx) + m_data.get_size(data_idx));
+
     // Overwrite with a void element.
-    m_data[data_idx]->m_size = 0;
+    m_data.set_size(data_idx, 0);
     handle_void_elements(data_idx);
   }
 }
 
+/** \brief Checks whether an element can be written before its old instances are overwritten
+
+    That is the case if none of the spaces the old instances leave
+    behind together with the EbmlVoid elements around them is large
+    enough for the new version, and if none of them is located at the
+    end of the file. The new version then ends up at the same spot no
+    matter whether the old instances are overwritten before or after
+    writing it, and it never overlaps them.
+ */
+bool
+kax_analyzer_c::can_write_before_overwriting(EbmlElement *e,
+                                             bool write_defaults) {
+  e->UpdateSize(write_defaults, true);
+
+  auto element_size = static_cast<int64_t>(e->ElementSize(write_defaults));
+  auto is_freed     = [this, e](size_t data_idx) {
+    return Is<EbmlVoid>(m_data.get_id(data_idx)) || (m_data.get_id(data_idx) == EbmlId(*e));
+  };
+
+  for (auto data_idx : m_data.find_all(EbmlId(*e))) {
+    auto first_idx = data_idx;
+    while ((0 < first_idx) && is_freed(first_idx - 1))
+      --first_idx;
+
+    auto end_idx = data_idx + 1;
+    while ((m_data.size() > end_idx) && is_freed(end_idx))
+      ++end_idx;
+
+    if (m_data.size() == end_idx)
+      return false;
+
+    auto start = 0 == first_idx ? m_data.get_pos(first_idx) : m_data.get_pos(first_idx - 1) + m_data.get_size(first_idx - 1);
+    if (static_cast<int64_t>(m_data.get_pos(end_idx) - start) >= element_size)
+      return false;
+  }
+
+  return true;
+}
+
 /** \brief Merges consecutive EbmlVoid elements into a single one
 
     Iterates over the level 1 elements in the file and merges
@@ -839,11 +2079,13 @@ kax_analyzer_c::overwrite_all_instances(EbmlId id) {
  */
 void
 kax_analyzer_c::merge_void_elements() {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "merge_void_elements"};
+
   size_t start_idx = 0;
 
   while (m_data.size() > start_idx) {
     // We only have to do work on EbmlVoid elements. Skip the others.
-    if (!Is<EbmlVoid>(m_data[start_idx]->m_id)) {
+    if (!Is<EbmlVoid>(m_data.get_id(start_idx))) {
       ++start_idx;
       continue;
     }
@@ -851,9 +2093,9 @@ kax_analyzer_c::merge_void_elements() {
     // Found an EbmlVoid element. See how many consecutive EbmlVoid elements
     // there are at this position and calculate the combined size.
     size_t end_idx  = start_idx + 1;
-    size_t new_size = m_data[start_idx]->m_size;
-    while ((m_data.size() > end_idx) && Is<EbmlVoid>(m_data[end_idx]->m_id)) {
-      new_size += m_data[end_idx]->m_size;
+    size_t new_size = m_data.get_size(start_idx);
+    while ((m_data.size() > end_idx) && Is<EbmlVoid>(m_data.get_id(end_idx))) {
+      new_size += m_data.get_size(end_idx);
       ++end_idx;
     }
 
@@ -864,7 +2106,7 @@ kax_analyzer_c::merge_void_elements() {
     }
 
     // Write the new EbmlVoid element to the file.
-    m_file->setFilePointer(m_data[start_idx]->m_pos);
+    m_file->setFilePointer(m_data.get_pos(start_idx));
 
     EbmlVoid evoid;
     evoid.SetSize(new_size);
@@ -873,8 +2115,13 @@ kax_analyzer_c::merge_void_elements() {
     evoid.Render(*m_file);
 
     // Update the internal records to reflect the changes.
-    m_data[start_idx]->m_size = new_size;
-    m_data.erase(m_data.begin() + start_idx + 1, m_data.begin() + end_idx);
+    for (auto void_idx = start_idx; void_idx < end_idx; ++void_idx)
+      free_space_removed(void_idx);
+
+    m_data.set_size(start_idx, new_size);
+    m_data.erase(start_idx + 1, end_idx);
+
+    free_space_added(start_idx);
 
     start_idx += 2;
   }
@@ -882,23 +2129,218 @@ kax_analyzer_c::merge_void_elements() {
   // See how many void elements there are at the end of the file.
   start_idx = m_data.size();
 
-  while ((0 < start_idx) && Is<EbmlVoid>(m_data[start_idx - 1]->m_id))
+  while ((0 < start_idx) && Is<EbmlVoid>(m_data.get_id(start_idx - 1)))
     --start_idx;
 
   // If there are none then we're done.
   if (m_data.size() <= start_idx)
     return;
 
-  // Truncate the file after the last non-void element and update the segment size.
-  m_file->truncate(m_data[start_idx]->m_pos);
+  // Truncate the file after the last non-void element and update the
+  // segment size. The void elements are gone afterwards, and elements
+  // written at the end of the file will start where they did.
+  m_file->truncate(m_data.get_pos(start_idx));
+
+  for (auto void_idx = start_idx; void_idx < m_data.size(); ++void_idx)
+    free_space_removed(void_idx);
+
+  m_data.erase(start_idx, m_data.size());
+
   adjust_segment_size();
 }
 
+namespace {
+
+/** \brief Compares the data rendered into it with the file's content
+
+   The data is collected in chunks of at most \c PATCH_CHUNK_SIZE
+   bytes. Each chunk is compared with the bytes at the same offset
+   relative to \c position in the file and then discarded. Only the
+   range of differing bytes is kept.
+ */
+class patch_comparison_c: public mm_null_io_c {
+protected:
+  mm_io_c &m_file;
+  uint64_t m_position, m_chunk_offset{}, m_first, m_last{};
+  std::vector<unsigned char> m_new_chunk, m_old_chunk;
+  bool m_read_failed{};
+
+public:
+  patch_comparison_c(mm_io_c &file, uint64_t position)
+    : mm_null_io_c{file.get_file_name()}
+    , m_file(file)
+    , m_position{position}
+    , m_first{std::numeric_limits<uint64_t>::max()}
+  {
+  }
+
+  // Sets the offsets of the first differing byte and of the byte after
+  // the last one. Returns false if reading the file failed.
+  bool finish(uint64_t &first,
+              uint64_t &last) {
+    compare_chunk();
+
+    first = std::min(m_first, m_last);
+    last  = m_last;
+
+    return !m_read_failed;
+  }
+
+protected:
+  virtual size_t _write(const void *buffer, size_t size) {
+    if (static_cast<uint64_t>(m_pos) != (m_chunk_offset + m_new_chunk.size())) {
+      compare_chunk();
+      m_chunk_offset = m_pos;
+    }
+
+    auto data = static_cast<unsigned char const *>(buffer);
+    auto done = static_cast<size_t>(0);
+
+    while (done < size) {
+      auto chunk_size = std::min<size_t>(size - done, PATCH_CHUNK_SIZE - m_new_chunk.size());
+      m_new_chunk.insert(m_new_chunk.end(), data + done, data + done + chunk_size);
+      done += chunk_size;
+
+      if (m_new_chunk.size() == PATCH_CHUNK_SIZE)
+        compare_chunk();
+    }
+
+    return mm_null_io_c::_write(buffer, size);
+  }
+
+  void compare_chunk() {
+    if (m_new_chunk.empty())
+      return;
+
+    m_old_chunk.resize(m_new_chunk.size());
+    m_file.setFilePointer(m_position + m_chunk_offset);
+
+    if (m_file.read(m_old_chunk.data(), m_old_chunk.size()) != m_old_chunk.size())
+      m_read_failed = true;
+
+    else {
+      auto first = std::mismatch(m_new_chunk.begin(),  m_new_chunk.end(),  m_old_chunk.begin());
+      auto last  = std::mismatch(m_new_chunk.rbegin(), m_new_chunk.rend(), m_old_chunk.rbegin());
+
+      if (first.first != m_new_chunk.end()) {
+        m_first = std::min<uint64_t>(m_first, m_chunk_offset + (first.first - m_new_chunk.begin()));
+        m_last  = std::max<uint64_t>(m_last,  m_chunk_offset + (m_new_chunk.rend() - last.first));
+      }
+    }
+
+    m_chunk_offset += m_new_chunk.size();
+    m_new_chunk.clear();
+  }
+};
+
+/** \brief Writes the part of the data rendered into it that lies in a range
+
+   Offsets are relative to \c position in the file. Everything outside
+   the range from \c first up to \c last is dropped.
+ */
+class patch_writer_c: public mm_null_io_c {
+protected:
+  mm_io_c &m_file;
+  uint64_t m_position, m_first, m_last;
+
+public:
+  patch_writer_c(mm_io_c &file, uint64_t position, uint64_t first, uint64_t last)
+    : mm_null_io_c{file.get_file_name()}
+    , m_file(file)
+    , m_position{position}
+    , m_first{first}
+    , m_last{last}
+  {
+  }
+
+protected:
+  virtual size_t _write(const void *buffer, size_t size) {
+    auto start = std::max<uint64_t>(m_pos,        m_first);
+    auto end   = std::min<uint64_t>(m_pos + size, m_last);
+
+    if (start < end) {
+      m_file.setFilePointer(m_position + start);
+      if (m_file.write(static_cast<unsigned char const *>(buffer) + (start - m_pos), end - start) != (end - start))
+        throw kax_analyzer_c::uer_error_unknown;
+    }
+
+    return mm_null_io_c::_write(buffer, size);
+  }
+};
+
+}
+
+/** \brief Overwrites an element in place if its size hasn't changed
+
+    This is a shortcut for the common case of changing a property
+    without changing the size of the element containing it, e.g.
+    toggling a flag. The element is rendered and compared chunk by
+    chunk to its current content in the file. Only the range of bytes
+    differing is written by rendering the element a second time.
+    Neither the EbmlVoid elements nor the meta seek elements have to
+    be touched. Lazily read payloads are streamed during both passes
+    and only read into memory if they are located in the range being
+    written.
+
+    This is only possible if the element was read from the file and
+    if it is the only instance of its kind. Otherwise the full update
+    process is required for merging all instances into one.
+
+    \return \c true if the element has been written and \c false if
+      it has to go through the full update process.
+ */
+bool
+kax_analyzer_c::patch_element_in_place(EbmlElement *e,
+                                       bool write_defaults) {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "write_element"};
+
+  auto position = e->GetElementPosition();
+  auto data_idx = m_data.find_by_position(position);
+
+  if (   (-1 == data_idx)
+      || (m_data.get_id(data_idx) != EbmlId(*e))
+      || !m_data.is_size_known(data_idx)
+      || (m_data.find_all(EbmlId(*e)).size() != 1))
+    return false;
+
+  e->UpdateSize(write_defaults, true);
+
+  auto size = static_cast<uint64_t>(m_data.get_size(data_idx));
+  if (e->ElementSize(write_defaults) != size)
+    return false;
+
+  patch_comparison_c comparison{*m_file, position};
+  e->Render(comparison, write_defaults, true, true);
+
+  if (comparison.getFilePointer() != size)
+    return false;
+
+  uint64_t first = 0, last = 0;
+  if (!comparison.finish(first, last))
+    return false;
+
+  mxdebug_if(m_debug, strformat::bstr("patch_element_in_place: %1% at %2% size %3% patching %4% bytes at offset %5%\n") % EBML_NAME(e) % position % size % (last - first) % first);
+
+  if (last > first) {
+    load_lazy_payloads(position + first, position + last);
+
+    patch_writer_c writer{*m_file, position, first, last};
+    e->Render(writer, write_defaults, true, true);
+  }
+
+  ++m_placement_statistics.m_num_written;
+  ++m_placement_statistics.m_num_patched;
+
+  return true;
+}
+
 /** \brief Finds a suitable spot for an element and writes it to the file
 
     First, a suitable spot for the element is determined by looking at
-    EbmlVoid elements. If none is found in the middle of the file then
-    the element will be appended at the end.
+    EbmlVoid elements. The smallest one that is large enough is used,
+    preferring those located before the first cluster. If none is
+    found in the middle of the file then the element will be appended
+    at the end.
 
     Second, the element is written at the location determined in the
     first step. If EbmlVoid elements are overwritten then a new,
@@ -907,6 +2349,14 @@ kax_analyzer_c::merge_void_elements() {
 
     Third, the internal records are updated to reflect the changes.
 
+    If a padding policy is set then elements that may be placed
+    anywhere are put back at their previous position if they still
+    fit there. Otherwise a spot before the first cluster is looked for
+    that leaves the policy's amount of padding behind the element so
+    that the element can grow in place during later edits. Padding is
+    never reserved at the end of the file as trailing EbmlVoid
+    elements are removed.
+
     \param e Pointer to the element to write.
     \param write_defaults Boolean that decides whether or not elements
       which contain their default value are written to the file.
@@ -915,26 +2365,63 @@ void
 kax_analyzer_c::write_element(EbmlElement *e,
                               bool write_defaults,
                               placement_strategy_e strategy) {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "write_element"};
+
   e->UpdateSize(write_defaults, true);
   int64_t element_size = e->ElementSize(write_defaults);
 
-  size_t data_idx;
-  for (data_idx = (ps_anywhere == strategy ? 0 : m_data.size() - 1); m_data.size() > data_idx; ++data_idx) {
-    // We're only interested in EbmlVoid elements. Skip the others.
-    if (!Is<EbmlVoid>(m_data[data_idx]->m_id))
-      continue;
+  mbalgm::optional<size_t> free_idx;
+  auto padding = static_cast<int64_t>(0);
 
-    // Skip the element if it doesn't provide enough space.
-    if (m_data[data_idx]->m_size < element_size)
-      continue;
+  ++m_placement_statistics.m_num_written;
+
+  if ((ps_anywhere == strategy) && m_padding_policy.is_enabled()) {
+    free_idx = find_free_space_at_previous_position(EbmlId(*e), element_size);
+
+    if (!free_idx) {
+      padding  = m_padding_policy.get_padding_for(element_size);
+      free_idx = find_free_space(element_size + padding, kax_analyzer_free_space_c::region_front, false);
+
+      if (!free_idx)
+        padding = 0;
+    }
+  }
+
+  if (!free_idx) {
+    if (ps_anywhere == strategy)
+      free_idx = find_free_space(element_size, kax_analyzer_free_space_c::region_anywhere, true);
+
+    else if (!m_data.empty() && Is<EbmlVoid>(m_data.get_id(m_data.size() - 1)) && (m_data.get_size(m_data.size() - 1) >= element_size))
+      free_idx.reset(m_data.size() - 1);
+  }
+
+  if (free_idx) {
+    auto data_idx          = *free_idx;
+    auto previous_position = m_previous_positions.find(EBML_ID_VALUE(EbmlId(*e)));
+    auto in_place          = (previous_position != m_previous_positions.end()) && (previous_position->second == m_data.get_pos(data_idx));
+
+    mxdebug_if(m_debug,
+               strformat::bstr("write_element: %1% at %2% in place %3% padding %4%\n")
+               % EBML_NAME(e) % m_data.get_pos(data_idx) % in_place % padding);
+
+    if (in_place)
+      ++m_placement_statistics.m_num_in_place;
+    else
+      ++m_placement_statistics.m_num_in_free_space;
+
+    if (padding) {
+      ++m_placement_statistics.m_num_padded;
+      m_placement_statistics.m_padding_reserved += padding;
+    }
 
     // We've found our element. Overwrite it.
-    m_file->setFilePointer(m_data[data_idx]->m_pos);
+    free_space_removed(data_idx);
+    m_file->setFilePointer(m_data.get_pos(data_idx));
     e->Render(*m_file, write_defaults, false, true);
 
     // Update the internal records.
-    m_data[data_idx]->m_id   = EbmlId(*e);
-    m_data[data_idx]->m_size = e->ElementSize(write_defaults);
+    m_data.set_id(data_idx, EbmlId(*e));
+    m_data.set_size(data_idx, e->ElementSize(write_defaults));
 
     // Create a new void element after the element we've just written.
     handle_void_elements(data_idx);
@@ -945,9 +2432,11 @@ kax_analyzer_c::write_element(EbmlElement *e,
 
   // We haven't found a suitable place. So store the element at the end of the file
   // and update the internal records.
+  ++m_placement_statistics.m_num_at_end;
+
   m_file->setFilePointer(0, seek_end);
   e->Render(*m_file, write_defaults, false, true);
-  m_data.push_back(kax_analyzer_data_c::create(EbmlId(*e), m_file->getFilePointer() - e->ElementSize(write_defaults), e->ElementSize(write_defaults)));
+  m_data.push_back(EbmlId(*e), m_file->getFilePointer() - e->ElementSize(write_defaults), e->ElementSize(write_defaults));
 
   // Adjust the segment's size.
   adjust_segment_size();
@@ -967,15 +2456,15 @@ kax_analyzer_c::ensure_front_seek_head_links_to(unsigned int seek_head_idx) {
   mbalgm::optional<unsigned int> first_seek_head_idx;
 
   for (int data_idx = 0, end = m_data.size(); end > data_idx; ++data_idx) {
-    auto const &data = *m_data[data_idx];
+    auto const id = m_data.get_id(data_idx);
 
-    if (Is<KaxSeekHead>(data.m_id)) {
+    if (Is<KaxSeekHead>(id)) {
       if (static_cast<unsigned int>(data_idx) == seek_head_idx)
         return seek_head_idx;
 
       first_seek_head_idx.reset(data_idx);
 
-    } else if (Is<KaxCluster>(data.m_id))
+    } else if (Is<KaxCluster>(id))
       break;
   }
 
@@ -989,7 +2478,7 @@ kax_analyzer_c::ensure_front_seek_head_links_to(unsigned int seek_head_idx) {
   // start.
   mxdebug_if(m_debug, strformat::bstr("  no seek head at start but one at the end\n"));
 
-  auto seek_head_position = m_segment->GetRelativePosition(m_data[seek_head_idx]->m_pos);
+  auto seek_head_position = m_segment->GetRelativePosition(m_data.get_pos(seek_head_idx));
   auto seek_head_id       = memory_c::alloc(4);
 
   put_uint32_be(seek_head_id->get_buffer(), EBML_ID(KaxSeekHead).GetValue());
@@ -1005,30 +2494,23 @@ kax_analyzer_c::ensure_front_seek_head_links_to(unsigned int seek_head_idx) {
 
   while (first_time) {
     mxdebug_if(m_debug, strformat::bstr("  looking for place for the new seek head at the start…\n"));
-    // Find a place at the front with enough space.
-    for (int data_idx = 0, end = m_data.size(); data_idx < end; ++data_idx) {
-      auto &data = *m_data[data_idx];
-
-      if (Is<KaxCluster>(data.m_id))
-        break;
-
-      if (!Is<EbmlVoid>(data.m_id))
-        continue;
-
-      // Avoid the case with the space being only one byte larger than
-      // what we need. That would require moving the next element one
-      // byte to the front triggering seek head adjustments.
-      if ((data.m_size != needed_size) && (data.m_size < (needed_size + 2)))
-        continue;
-
-      mxdebug_if(m_debug, strformat::bstr("  got one! writing at file position %1%\n") % data.m_pos);
+    // Find a place at the front with enough space. Avoid the case with
+    // the space being only one byte larger than what we need. That
+    // would require moving the next element one byte to the front
+    // triggering seek head adjustments.
+    auto free_idx = find_free_space(needed_size, kax_analyzer_free_space_c::region_front, false);
+    if (free_idx) {
+      auto data_idx = *free_idx;
+
+      mxdebug_if(m_debug, strformat::bstr("  got one! writing at file position %1%\n") % m_data.get_pos(data_idx));
       // Got a place. Write the seek head, update the internal record &
       // write a new void element.
-      m_file->setFilePointer(data.m_pos);
+      free_space_removed(data_idx);
+      m_file->setFilePointer(m_data.get_pos(data_idx));
       new_seek_head->Render(*m_file, true);
 
-      data.m_size = needed_size;
-      data.m_id   = EBML_ID(KaxSeekHead);
+      m_data.set_size(data_idx, needed_size);
+      m_data.set_id(data_idx,   EBML_ID(KaxSeekHead));
 
       handle_void_elements(data_idx);
 
@@ -1050,23 +2532,23 @@ kax_analyzer_c::ensure_front_seek_head_links_to(unsigned int seek_head_idx) {
 }
 
 std::pair<bool, int>
-kax_analyzer_c::try_adding_to_existing_meta_seek(EbmlElement *e) {
+kax_analyzer_c::try_adding_to_existing_meta_seek(std::vector<EbmlElement *> const &elements) {
   auto first_seek_head_idx = -1;
 
   for (auto data_idx = 0u; m_data.size() > data_idx; ++data_idx) {
     // We only have to do work on SeekHead elements. Skip the others.
-    if (!Is<KaxSeekHead>(m_data[data_idx]->m_id))
+    if (!Is<KaxSeekHead>(m_data.get_id(data_idx)))
       continue;
 
     // Calculate how much free space there is behind the seek head.
     // merge_void_elemens() guarantees that there is no EbmlVoid element
     // at the end of the file and that all consecutive EbmlVoid elements
     // have been merged into a single element.
-    size_t available_space = m_data[data_idx]->m_size;
-    if (((data_idx + 1) < m_data.size()) && Is<EbmlVoid>(m_data[data_idx + 1]->m_id))
-      available_space += m_data[data_idx + 1]->m_size;
+    size_t available_space = m_data.get_size(data_idx);
+    if (((data_idx + 1) < m_data.size()) && Is<EbmlVoid>(m_data.get_id(data_idx + 1)))
+      available_space += m_data.get_size(data_idx + 1);
 
-    // Read the seek head, index the element and see how much space it needs.
+    // Read the seek head, index the elements and see how much space it needs.
     ebml_element_cptr element = read_element(data_idx);
     KaxSeekHead *seek_head    = dynamic_cast<KaxSeekHead *>(element.get());
     if (!seek_head)
@@ -1075,7 +2557,8 @@ kax_analyzer_c::try_adding_to_existing_meta_seek(EbmlElement *e) {
     if (-1 == first_seek_head_idx)
       first_seek_head_idx = data_idx;
 
-    seek_head->IndexThis(*e, *m_segment.get());
+    for (auto e : elements)
+      seek_head->IndexThis(*e, *m_segment.get());
     seek_head->UpdateSize(true);
 
     // We can use this seek head if it is at the end of the file, or if there
@@ -1084,11 +2567,11 @@ kax_analyzer_c::try_adding_to_existing_meta_seek(EbmlElement *e) {
       continue;
 
     // Write the seek head.
-    m_file->setFilePointer(m_data[data_idx]->m_pos);
+    m_file->setFilePointer(m_data.get_pos(data_idx));
     seek_head->Render(*m_file, true);
 
     // Update the internal record.
-    m_data[data_idx]->m_size = seek_head->ElementSize(true);
+    m_data.set_size(data_idx, seek_head->ElementSize(true));
 
     // If this seek head is located at the end of the file then we have
     // to adjust the segment size.
@@ -1113,39 +2596,124 @@ kax_analyzer_c::try_adding_to_existing_meta_seek(EbmlElement *e) {
   return { false, first_seek_head_idx };
 }
 
-void
-kax_analyzer_c::move_seek_head_to_end_and_create_new_one_at_start(EbmlElement *e,
-                                                                  int first_seek_head_idx) {
-  // Read the first seek head…
-  ebml_element_cptr element = read_element(first_seek_head_idx);
+/** \brief Copies a seek head to the end of the file and indexes elements in it
+
+    Only the seek head's ID and size are parsed. Its content is copied
+    verbatim with a buffer of a fixed size, and entries for the
+    \c elements are appended to it. Seek heads protected by a CRC-32
+    element are re-rendered instead as their checksum would have to
+    be re-calculated over the whole content.
+
+    \param seek_head_idx Index of the seek head to copy.
+    \param elements Pointers to the elements to index.
+
+    \return The size of the new seek head including its head.
+ */
+uint64_t
+kax_analyzer_c::copy_seek_head_to_end(size_t seek_head_idx,
+                                      std::vector<EbmlElement *> const &elements) {
+  auto seek_head = read_element_head(seek_head_idx);
+  if (!seek_head)
+    throw uer_error_unknown;
+
+  uint64_t content_pos  = m_data.get_pos(seek_head_idx) + seek_head->HeadSize();
+  uint64_t content_size = seek_head->GetSize();
+
+  if (content_size) {
+    m_file->setFilePointer(content_pos);
+    if (m_file->read_uint8() == EBML_ID_VALUE(EBML_ID(EbmlCrc32)))
+      return render_seek_head_at_end(seek_head_idx, elements);
+  }
+
+  // Render the new entries…
+  KaxSeekHead new_entries;
+  for (auto e : elements)
+    new_entries.IndexThis(*e, *m_segment.get());
+
+  mm_mem_io_c entries{nullptr, 0, 1024};
+  for (auto child : new_entries)
+    child->Render(entries, true);
+
+  // …write a new head followed by the old content…
+  uint64_t new_content_size = content_size + entries.getFilePointer();
+
+  binary head[4 + 8];
+  unsigned int head_size = EBML_ID_LENGTH(static_cast<const EbmlId &>(EBML_ID(KaxSeekHead)));
+  EBML_ID(KaxSeekHead).Fill(head);
+  head_size += CodedValueLength(new_content_size, CodedSizeLength(new_content_size, 0, true), &head[head_size]);
+
+  m_file->setFilePointer(0, seek_end);
+  auto position = m_file->getFilePointer();
+
+  if (   (m_file->write(head, head_size) != head_size)
+      || !copy_file_data(content_pos, position + head_size, content_size))
+    throw uer_error_unknown;
+
+  // …and append the new entries.
+  m_file->setFilePointer(0, seek_end);
+  if (m_file->write(entries.get_buffer(), entries.getFilePointer()) != entries.getFilePointer())
+    throw uer_error_unknown;
+
+  return head_size + new_content_size;
+}
+
+/** \brief Renders a seek head with additional elements at the end of the file
+
+    The seek head is read completely, the \c elements are indexed, and
+    the result is rendered at the end of the file.
+
+    \param seek_head_idx Index of the seek head to copy.
+    \param elements Pointers to the elements to index.
+
+    \return The size of the new seek head including its head.
+ */
+uint64_t
+kax_analyzer_c::render_seek_head_at_end(size_t seek_head_idx,
+                                        std::vector<EbmlElement *> const &elements) {
+  ebml_element_cptr element = read_element(seek_head_idx);
   KaxSeekHead *seek_head    = dynamic_cast<KaxSeekHead *>(element.get());
   if (!seek_head)
     throw uer_error_unknown;
 
-  // …index our element…
-  seek_head->IndexThis(*e, *m_segment.get());
+  for (auto e : elements)
+    seek_head->IndexThis(*e, *m_segment.get());
   seek_head->UpdateSize(true);
 
-  // …write the seek head at the end of the file…
   m_file->setFilePointer(0, seek_end);
   seek_head->Render(*m_file, true);
 
+  return seek_head->ElementSize(true);
+}
+
+void
+kax_analyzer_c::move_seek_head_to_end_and_create_new_one_at_start(std::vector<EbmlElement *> const &elements,
+                                                                  int first_seek_head_idx) {
+  // Copy the first seek head with our elements indexed to the end of
+  // the file…
+  m_file->setFilePointer(0, seek_end);
+  auto position = m_file->getFilePointer();
+  auto size     = copy_seek_head_to_end(first_seek_head_idx, elements);
+
   // …and update the internal records.
-  m_data.push_back(kax_analyzer_data_c::create(EBML_ID(KaxSeekHead), seek_head->GetElementPosition(), seek_head->ElementSize(true)));
+  m_data.push_back(EBML_ID(KaxSeekHead), position, size);
 
   // Update the segment size.
   adjust_segment_size();
 
+  auto seek_head = read_element_head(m_data.size() - 1);
+  if (!seek_head)
+    throw uer_error_unknown;
+
   // Create a new seek head and write it to the file.
   std::shared_ptr<KaxSeekHead> forward_seek_head(new KaxSeekHead);
   forward_seek_head->IndexThis(*seek_head, *m_segment.get());
   forward_seek_head->UpdateSize(true);
 
-  m_file->setFilePointer(m_data[first_seek_head_idx]->m_pos);
+  m_file->setFilePointer(m_data.get_pos(first_seek_head_idx));
   forward_seek_head->Render(*m_file, true);
 
   // Update the internal record to reflect that there's a new seek head.
-  m_data[first_seek_head_idx]->m_size = forward_seek_head->ElementSize(true);
+  m_data.set_size(first_seek_head_idx, forward_seek_head->ElementSize(true));
 
   // Create a void element behind the small new first seek head.
   handle_void_elements(first_seek_head_idx);
@@ -1154,27 +2722,26 @@ kax_analyzer_c::move_seek_head_to_end_and_create_new_one_at_start(EbmlElement *e
 }
 
 bool
-kax_analyzer_c::create_new_meta_seek_at_start(EbmlElement *e) {
+kax_analyzer_c::create_new_meta_seek_at_start(std::vector<EbmlElement *> const &elements) {
   auto new_seek_head = std::make_shared<KaxSeekHead>();
-  new_seek_head->IndexThis(*e, *m_segment.get());
+  for (auto e : elements)
+    new_seek_head->IndexThis(*e, *m_segment.get());
   new_seek_head->UpdateSize(true);
 
-  for (auto data_idx = 0u; m_data.size() > data_idx; ++data_idx) {
-    // We can only overwrite void elements. Skip the others.
-    if (!Is<EbmlVoid>(m_data[data_idx]->m_id))
-      continue;
-
-    // Skip the element if it doesn't offer enough space for the seek head.
-    if (m_data[data_idx]->m_size < static_cast<int64_t>(new_seek_head->ElementSize(true)))
-      continue;
+  // We can only overwrite void elements that offer enough space for
+  // the seek head.
+  auto free_idx = find_free_space(new_seek_head->ElementSize(true), kax_analyzer_free_space_c::region_anywhere, true);
+  if (free_idx) {
+    auto data_idx = *free_idx;
 
     // We've found a suitable spot. Write the seek head.
-    m_file->setFilePointer(m_data[data_idx]->m_pos);
+    free_space_removed(data_idx);
+    m_file->setFilePointer(m_data.get_pos(data_idx));
     new_seek_head->Render(*m_file, true);
 
     // Adjust the internal records for the new seek head.
-    m_data[data_idx]->m_size = new_seek_head->ElementSize(true);
-    m_data[data_idx]->m_id   = EBML_ID(KaxSeekHead);
+    m_data.set_size(data_idx, new_seek_head->ElementSize(true));
+    m_data.set_id(data_idx, EBML_ID(KaxSeekHead));
 
     // Write a void element after the newly written seek head in order to
     // cover the space previously occupied by the old void element.
@@ -1192,7 +2759,7 @@ kax_analyzer_c::move_level1_element_before_cluster_to_end_of_file() {
   auto candidates_for_moving = std::vector<std::pair<int, unsigned int> >{};
 
   for (auto data_idx = 0u; m_data.size() > data_idx; ++data_idx) {
-    auto const &id = m_data[data_idx]->m_id;
+    auto const &id = m_data.get_id(data_idx);
 
     if (Is<KaxCluster>(id))
       break;
@@ -1217,24 +2784,27 @@ kax_analyzer_c::move_level1_element_before_cluster_to_end_of_file() {
   brng::sort(candidates_for_moving);
 
   auto const to_move_idx = candidates_for_moving.front().second;
-  auto const &to_move    = *m_data[to_move_idx];
+  auto const to_move     = kax_analyzer_data_c{m_data, to_move_idx};
 
   mxdebug_if(m_debug, strformat::bstr("Moving level 1 at index %1% to the end (%2%)\n") % to_move_idx % to_move.to_string());
 
-  // We read the element and write it again at the end of the file.
-  m_file->setFilePointer(to_move.m_pos);
-  auto buf = m_file->read(to_move.m_size);
-
+  // We copy the element verbatim to the end of the file. Its content
+  // is never parsed so that large attachments don't have to be kept
+  // in memory.
   m_file->setFilePointer(0, seek_end);
   auto position = m_file->getFilePointer();
 
-  m_file->write(buf);
+  load_lazy_payloads(to_move.m_pos, to_move.m_pos + to_move.m_size);
+
+  if (!copy_file_data(to_move.m_pos, position, to_move.m_size))
+    throw uer_error_unknown;
 
   // Update the internal records.
-  m_data.push_back(kax_analyzer_data_c::create(to_move.m_id, position, to_move.m_size));
+  m_data.push_back(to_move.m_id, position, to_move.m_size);
+  adjust_segment_size();
 
   // Overwrite with a void element.
-  m_data[to_move_idx]->m_size = 0;
+  m_data.set_size(to_move_idx, 0);
   handle_void_elements(to_move_idx);
 
   debug_dump_elements_maybe("move_level1_element_before_cluster_to_end_of_file");
@@ -1242,30 +2812,32 @@ kax_analyzer_c::move_level1_element_before_cluster_to_end_of_file() {
   verify_data_structures_against_file("move_level1_element_before_cluster_to_end_of_file");
 
   // And add it to a meta seek element.
-  auto e = read_element(m_data.size() - 1);
+  auto e = read_element_head(m_data.size() - 1);
   if (!e)
     throw uer_error_unknown;
 
-  add_to_meta_seek(e.get());
+  add_to_meta_seek({ e.get() });
 
   return true;
 }
 
-/** \brief Adds an element to one of the meta seek entries
+/** \brief Adds elements to one of the meta seek entries
 
     This function iterates over all meta seek elements and looks
     for one that has enough space (via following EbmlVoid elements or
     because it is located at the end of the file) for indexing
-    the element \c e.
+    all of the \c elements.
 
     If no such element is found then a new meta seek element is
-    created at an appropriate place, and that element is indexed.
+    created at an appropriate place, and the elements are indexed.
 
-    \param e Pointer to the element to index.
+    \param elements Pointers to the elements to index.
  */
 void
-kax_analyzer_c::add_to_meta_seek(EbmlElement *e) {
-  auto result = try_adding_to_existing_meta_seek(e);
+kax_analyzer_c::add_to_meta_seek(std::vector<EbmlElement *> const &elements) {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "meta_seek"};
+
+  auto result = try_adding_to_existing_meta_seek(elements);
 
   if (result.first)
     return;
@@ -1278,19 +2850,19 @@ kax_analyzer_c::add_to_meta_seek(EbmlElement *e) {
   // end.
 
   if (-1 != result.second) {
-    move_seek_head_to_end_and_create_new_one_at_start(e, result.second);
+    move_seek_head_to_end_and_create_new_one_at_start(elements, result.second);
     return;
   }
 
   // We don't have a seek head to copy. Create one before the first chapter if possible.
-  if (create_new_meta_seek_at_start(e))
+  if (create_new_meta_seek_at_start(elements))
     return;
 
   // We haven't found a place for the new seek head before the first
   // cluster. Therefore we must try to move an existing level 1
   // element to the end of the file first.
   if (move_level1_element_before_cluster_to_end_of_file()) {
-    add_to_meta_seek(e);
+    add_to_meta_seek(elements);
     return;
   }
 
@@ -1304,14 +2876,15 @@ kax_analyzer_c::read_all(const EbmlCallbacks &callbacks) {
 
   ebml_master_cptr master;
   EbmlStream es(*m_file);
+  EbmlArena arena;
+  EbmlArena::Scope arena_scope{arena};
   size_t i;
 
   for (i = 0; m_data.size() > i; ++i) {
-    kax_analyzer_data_c &data = *m_data[i].get();
-    if (EBML_INFO_ID(callbacks) != data.m_id)
+    if (EBML_INFO_ID(callbacks) != m_data.get_id(i))
       continue;
 
-    m_file->setFilePointer(data.m_pos);
+    m_file->setFilePointer(m_data.get_pos(i));
     int upper_lvl_el     = 0;
     EbmlElement *element = es.FindNextElement(EBML_CLASS_CONTEXT(KaxSegment), upper_lvl_el, 0xFFFFFFFFL, true);
     if (!element)
@@ -1323,7 +2896,7 @@ kax_analyzer_c::read_all(const EbmlCallbacks &callbacks) {
     }
 
     EbmlElement *l2 = nullptr;
-    element->Read(*m_stream, EBML_INFO_CONTEXT(callbacks), upper_lvl_el, l2, true);
+    element->Read(*m_stream, EBML_INFO_CONTEXT(callbacks), upper_lvl_el, l2, true, m_lazy_payloads ? SCOPE_LAZY_DATA : SCOPE_ALL_DATA);
 
     if (!master)
       master = ebml_master_cptr(static_cast<EbmlMaster *>(element));
@@ -1340,24 +2913,29 @@ kax_analyzer_c::read_all(const EbmlCallbacks &callbacks) {
   if (master && (master->ListSize() == 0))
     master.reset();
 
+  if (master && m_lazy_payloads)
+    m_lazy_elements.emplace_back(master);
+
   return master;
 }
 
 void
 kax_analyzer_c::read_all_meta_seeks() {
+  mm_io_accounting_c::phase_c io_phase{m_io_accounting, "meta_seek"};
+
   m_meta_seeks_by_position.clear();
 
   unsigned int i, num_entries = m_data.size();
   std::map<int64_t, bool> positions_found;
 
   for (i = 0; i < num_entries; i++)
-    positions_found[m_data[i]->m_pos] = true;
+    positions_found[m_data.get_pos(i)] = true;
 
   for (i = 0; i < num_entries; i++)
-    if (Is<KaxSeekHead>(m_data[i]->m_id))
-      read_meta_seek(m_data[i]->m_pos, positions_found);
+    if (Is<KaxSeekHead>(m_data.get_id(i)))
+      read_meta_seek(m_data.get_pos(i), positions_found);
 
-  std::sort(m_data.begin(), m_data.end());
+  m_data.sort_by_position();
 }
 
 void
@@ -1385,6 +2963,13 @@ kax_analyzer_c::read_meta_seek(uint64_t pos,
   EbmlMaster *master = static_cast<EbmlMaster *>(l1);
   master->Read(*m_stream, EBML_CONTEXT(l1), upper_lvl_el, l2, true);
 
+  // All elements referenced here will be read soon. On high-latency
+  // storage fetching them all at once is a lot cheaper than fetching
+  // them one after the other.
+  for (auto child : *master)
+    if (Is<KaxSeek>(child))
+      m_file->prefetch(static_cast<KaxSeek *>(child)->Location() + m_segment->GetElementPosition() + m_segment->HeadSize(), SEEK_TARGET_PREFETCH_SIZE);
+
   unsigned int i;
   for (i = 0; master->ListSize() > i; i++) {
     if (!Is<KaxSeek>((*master)[i]))
@@ -1401,7 +2986,7 @@ kax_analyzer_c::read_meta_seek(uint64_t pos,
       continue;
 
     EbmlId the_id(seek_id->GetBuffer(), seek_id->GetSize());
-    m_data.push_back(kax_analyzer_data_c::create(the_id, seek_pos, -1));
+    m_data.push_back(the_id, seek_pos, -1);
     positions_found[seek_pos] = true;
 
     if (Is<KaxSeekHead>(the_id))
@@ -1415,8 +3000,8 @@ void
 kax_analyzer_c::fix_element_sizes(uint64_t file_size) {
   unsigned int i;
   for (i = 0; m_data.size() > i; ++i)
-    if (-1 == m_data[i]->m_size)
-      m_data[i]->m_size = ((i + 1) < m_data.size() ? m_data[i + 1]->m_pos : file_size) - m_data[i]->m_pos;
+    if (-1 == m_data.get_size(i))
+      m_data.set_size(i, ((i + 1) < m_data.size() ? m_data.get_pos(i + 1) : file_size) - m_data.get_pos(i));
 }
 
 void
@@ -1424,11 +3009,16 @@ kax_analyzer_c::fix_unknown_size_for_last_level1_element() {
   if (!m_data.size())
     return;
 
-  auto &data = *m_data.back();
+  auto last_idx = m_data.size() - 1;
+  auto data     = kax_analyzer_data_c{m_data, last_idx};
   if (data.m_size_known)
     return;
 
-  mxinfo(strformat::bstr("chunky bacon! data %1% seg end %2%\n") % data.to_string() % m_segment_end);
+  // Only format the messages if they're shown.
+  auto debug = analyzer_debugging_requested("fix_unknown_size");
+
+  if (debug)
+    log_debug_message(strformat::bstr("fix_unknown_size_for_last_level1_element: data %1% segment end %2%\n") % data.to_string() % m_segment_end);
 
   auto elt = read_element(m_data.size() - 1);
   if (!elt)
@@ -1444,10 +3034,13 @@ kax_analyzer_c::fix_unknown_size_for_last_level1_element() {
 
   elt->OverwriteHead(*m_stream, true);
 
-  data.m_size       = actual_size + head_size;
-  data.m_size_known = true;
+  m_data.set_size(last_idx,       actual_size + head_size);
+  m_data.set_size_known(last_idx, true);
+
+  invalidate_free_space();
 
-  log_debug_message(strformat::bstr("fix_unknown_size_for_last_level1_element: element fixed to new payload size %1% head size %2% segment end %3%\n") % actual_size % head_size % m_segment_end);
+  if (debug)
+    log_debug_message(strformat::bstr("fix_unknown_size_for_last_level1_element: element fixed to new payload size %1% head size %2% segment end %3%\n") % actual_size % head_size % m_segment_end);
 }
 
 kax_analyzer_c::placement_strategy_e
@@ -1518,20 +3111,15 @@ kax_analyzer_c::read_segment_uid_from(std::string const &file_name) {
 
 int
 kax_analyzer_c::find(EbmlId const &id) {
-  for (int idx = 0, end = m_data.size(); idx < end; idx++)
-    if (id == m_data[idx]->m_id)
-      return idx;
-
-  return -1;
+  return m_data.find(id);
 }
 
 void
 kax_analyzer_c::with_elements(const EbmlId &id,
                               std::function<void(kax_analyzer_data_c const &)> worker)
   const {
-  for (auto const &data : m_data)
-    if (data->m_id == id)
-      worker(*data);
+  for (auto data_idx : m_data.find_all(id))
+    worker(kax_analyzer_data_c{m_data, data_idx});
 }
 
 void
@@ -1540,6 +3128,159 @@ kax_analyzer_c::determine_webm() {
   m_is_webm     = doc_type && (doc_type->GetValue() == "webm");
 }
 
+memory_cptr
+kax_analyzer_c::read_segment_uid() {
+  auto info_idx = find(EBML_ID(KaxInfo));
+  if (-1 == info_idx)
+    return {};
+
+  auto info        = read_element(info_idx);
+  auto segment_uid = info ? FindChild<KaxSegmentUID>(static_cast<EbmlMaster *>(info.get())) : nullptr;
+
+  return segment_uid ? memory_c::clone(segment_uid->GetBuffer(), segment_uid->GetSize()) : memory_cptr{};
+}
+
+/** \brief Checks that an element is still located where the layout cache says
+
+    Reads the element's ID and coded size from the file and compares
+    them with the cached record. Only the head is read; the content is
+    never touched.
+
+    \param data The cached record to verify.
+    \param allow_smaller_size Elements found via meta seek entries in
+      fast parse mode are recorded with the distance to the following
+      element as their size. For these the actual size may be smaller.
+ */
+bool
+kax_analyzer_c::revalidate_element(kax_analyzer_data_c const &data,
+                                   bool allow_smaller_size) {
+  m_file->setFilePointer(data.m_pos);
+
+  auto id   = vint_c::read_ebml_id(*m_file);
+  auto size = vint_c::read(*m_file);
+
+  if (!id.is_valid() || !size.is_valid() || (EbmlId(id) != data.m_id))
+    return false;
+
+  if (!data.m_size_known || size.is_unknown())
+    return !data.m_size_known && size.is_unknown();
+
+  auto actual_size = id.m_coded_size + size.m_coded_size + size.m_value;
+
+  return (actual_size == data.m_size) || (allow_smaller_size && (actual_size < data.m_size));
+}
+
+/** \brief Restores the level 1 element layout from the layout cache
+
+    The cache is only used if its key matches the file: file size,
+    modification time, checksums over the file's head and tail as well
+    as the segment UID. Additionally each cached element apart from the
+    clusters is verified by reading its head. Clusters are never read
+    or rewritten while editing and are therefore not verified.
+
+    \return \c true if \c m_data has been restored and \c false if a
+      regular scan is required.
+ */
+bool
+kax_analyzer_c::load_layout_cache() {
+  kax_analyzer_layout_cache_c cache;
+  auto cache_file_name = kax_analyzer_layout_cache_c::get_cache_file_name_for(m_file_name);
+
+  if (!cache.load(cache_file_name)) {
+    mxdebug_if(m_debug, strformat::bstr("layout cache: no usable cache file '%1%'\n") % cache_file_name);
+    return false;
+  }
+
+  if (   (cache.m_segment_pos            != m_segment->GetElementPosition())
+      || (cache.m_segment_data_start_pos != get_segment_data_start_pos())
+      || (cache.m_segment_end            != m_segment_end)
+      || ((parse_mode_full == m_parse_mode) && !cache.m_parsed_fully)) {
+    mxdebug_if(m_debug, strformat::bstr("layout cache: segment geometry or parse mode mismatch\n"));
+    return false;
+  }
+
+  try {
+    if (!cache.m_key.matches_file(kax_analyzer_layout_cache_c::calculate_key(m_file_name, {}))) {
+      mxdebug_if(m_debug, strformat::bstr("layout cache: file size, modification time or checksums mismatch\n"));
+      return false;
+    }
+
+    m_data = std::move(cache.m_data);
+
+    for (auto data_idx = 0u; data_idx < m_data.size(); ++data_idx) {
+      auto data = kax_analyzer_data_c{m_data, data_idx};
+      if (!Is<KaxCluster>(data.m_id) && !revalidate_element(data, !cache.m_parsed_fully)) {
+        mxdebug_if(m_debug, strformat::bstr("layout cache: element verification failed for %1%\n") % data.to_string());
+        m_data.clear();
+        return false;
+      }
+    }
+
+    if (!cache.m_key.matches_segment_uid(read_segment_uid())) {
+      mxdebug_if(m_debug, strformat::bstr("layout cache: segment UID mismatch\n"));
+      m_data.clear();
+      return false;
+    }
+
+  } catch (mtx::mm_io::exception &) {
+    m_data.clear();
+    return false;
+
+  } catch (bfs::filesystem_error &) {
+    m_data.clear();
+    return false;
+  }
+
+  m_meta_seeks_by_position.clear();
+  for (auto position : cache.m_meta_seek_positions)
+    m_meta_seeks_by_position[position] = true;
+
+  mxdebug_if(m_debug, strformat::bstr("layout cache: restored %1% level 1 elements from '%2%'\n") % m_data.size() % cache_file_name);
+
+  validate_data_structures("load_layout_cache");
+
+  return true;
+}
+
+void
+kax_analyzer_c::save_layout_cache(memory_cptr const &segment_uid) {
+  auto cache_file_name = kax_analyzer_layout_cache_c::get_cache_file_name_for(m_file_name);
+
+  // A failed update leaves the file in an unknown state. Make sure a
+  // stale cache is never used for it.
+  if (m_layout_cache_invalid || m_data.empty() || !m_segment) {
+    mxdebug_if(m_debug, strformat::bstr("layout cache: removing '%1%'\n") % cache_file_name);
+    kax_analyzer_layout_cache_c::remove(cache_file_name);
+    return;
+  }
+
+  try {
+    kax_analyzer_layout_cache_c cache;
+
+    cache.m_key                    = kax_analyzer_layout_cache_c::calculate_key(m_file_name, segment_uid);
+    cache.m_segment_pos            = m_segment->GetElementPosition();
+    cache.m_segment_data_start_pos = get_segment_data_start_pos();
+    cache.m_segment_end            = m_segment->IsFiniteSize() ? get_segment_data_start_pos() + m_segment->GetSize() : cache.m_key.m_file_size;
+    cache.m_parsed_fully           = (-1 != m_data.find(EBML_ID(KaxCluster)))
+                                  && (parse_mode_full == m_parse_mode);
+    cache.m_data                   = m_data;
+
+    for (auto const &meta_seek : m_meta_seeks_by_position)
+      if (meta_seek.second)
+        cache.m_meta_seek_positions.push_back(meta_seek.first);
+
+    cache.save(cache_file_name);
+
+    mxdebug_if(m_debug, strformat::bstr("layout cache: saved %1% level 1 elements to '%2%'\n") % m_data.size() % cache_file_name);
+
+  } catch (mtx::mm_io::exception &) {
+    kax_analyzer_layout_cache_c::remove(cache_file_name);
+
+  } catch (bfs::filesystem_error &) {
+    kax_analyzer_layout_cache_c::remove(cache_file_name);
+  }
+}
+
 
 // ------------------------------------------------------------
 
@@ -1553,6 +3294,13 @@ console_kax_analyzer_c::console_kax_analyzer_c(std::string file_name)
 {
 }
 
+console_kax_analyzer_c::console_kax_analyzer_c(mm_io_c *file)
+  : kax_analyzer_c(file)
+  , m_show_progress(false)
+  , m_previous_percentage(-1)
+{
+}
+
 console_kax_analyzer_c::~console_kax_analyzer_c() {
 }
 
@@ -19,7 +19,11 @@
 #include <matroska/KaxSegment.h>
 
 #include "common/ebml.h"
+#include "common/kax_analyzer_free_space.h"
+#include "common/kax_analyzer_index.h"
+#include "common/mm_accounting_io.h"
 #include "common/mm_io.h"
+#include "common/mm_transaction_io.h"
 
 using namespace libebml;
 using namespace libmatroska;
@@ -53,6 +57,14 @@ public:
   {
   }
 
+  kax_analyzer_data_c(kax_analyzer_index_c const &index, size_t idx)
+    : m_id{index.get_id(idx)}
+    , m_pos{index.get_pos(idx)}
+    , m_size{index.get_size(idx)}
+    , m_size_known{index.is_size_known(idx)}
+  {
+  }
+
   std::string to_string() const;
 };
 
@@ -97,8 +109,29 @@ public:
     ps_end,
   };
 
+  struct update_request_t {
+    EbmlElement *m_element;
+    bool m_write_defaults, m_add_mandatory_elements_if_missing, m_remove;
+  };
+
+  // How much free space to leave behind level 1 elements written
+  // before the first cluster: the larger of a fixed number of bytes
+  // and a percentage of the element's size.
+  struct padding_policy_t {
+    int64_t m_size{};
+    unsigned int m_percentage{};
+
+    bool is_enabled() const;
+    int64_t get_padding_for(int64_t element_size) const;
+  };
+
+  struct placement_statistics_t {
+    unsigned int m_num_written{}, m_num_patched{}, m_num_in_place{}, m_num_in_free_space{}, m_num_at_end{}, m_num_padded{};
+    uint64_t m_padding_reserved{};
+  };
+
 private:
-  std::vector<kax_analyzer_data_cptr> m_data;
+  kax_analyzer_index_c m_data;
   std::string m_file_name;
   mm_io_c *m_file{};
   bool m_close_file{true};
@@ -107,12 +140,24 @@ private:
   uint64_t m_segment_end{};
   std::map<int64_t, bool> m_meta_seeks_by_position;
   EbmlStream *m_stream{};
-  debugging_option_c m_debug{"kax_analyzer"};
+  debugging_option_c m_debug{"kax_analyzer"}, m_debug_gaps{"kax_analyzer|kax_analyzer_gaps"}, m_debug_verify{"kax_analyzer|kax_analyzer_verify"};
   parse_mode_e m_parse_mode{parse_mode_full};
   open_mode m_open_mode{MODE_WRITE};
   bool m_throw_on_error{};
   mbalgm::optional<uint64_t> m_parser_start_position;
   bool m_is_webm{};
+  bool m_use_layout_cache{}, m_layout_cache_needs_saving{}, m_layout_cache_invalid{};
+  mm_transaction_io_c *m_transaction{};
+  kax_analyzer_free_space_c m_free_space;
+  bool m_free_space_valid{};
+  unsigned int m_num_analysis_threads{1};
+  padding_policy_t m_padding_policy;
+  placement_statistics_t m_placement_statistics;
+  std::map<uint32_t, uint64_t> m_previous_positions;
+  bool m_parallel_analysis_attempted{};
+  mm_io_accounting_cptr m_io_accounting;
+  bool m_lazy_payloads{};
+  std::vector<std::weak_ptr<EbmlElement>> m_lazy_elements;
 
 public:                         // Static functions
   static bool probe(std::string file_name);
@@ -125,6 +170,8 @@ public:
   virtual update_element_result_e update_element(EbmlElement *e, bool write_defaults = false, bool add_mandatory_elements_if_missing = true);
   virtual update_element_result_e update_element(ebml_element_cptr const &e, bool write_defaults = false, bool add_mandatory_elements_if_missing = true);
 
+  virtual update_element_result_e update_elements(std::vector<update_request_t> const &requests, EbmlElement **failed_element = nullptr);
+
   virtual update_element_result_e remove_elements(EbmlId const &id);
 
   virtual ebml_master_cptr read_all(const EbmlCallbacks &callbacks);
@@ -145,6 +192,14 @@ public:
   virtual kax_analyzer_c &set_open_mode(open_mode mode);
   virtual kax_analyzer_c &set_throw_on_error(bool throw_on_error);
   virtual kax_analyzer_c &set_parser_start_position(uint64_t position);
+  virtual kax_analyzer_c &set_layout_cache(bool use_layout_cache);
+  virtual kax_analyzer_c &set_analysis_threads(unsigned int num_threads);
+  virtual kax_analyzer_c &set_padding_policy(padding_policy_t const &padding_policy);
+  virtual kax_analyzer_c &set_io_accounting(bool enable);
+  virtual kax_analyzer_c &set_lazy_payloads(bool lazy_payloads);
+
+  virtual placement_statistics_t const &get_placement_statistics() const;
+  virtual mm_io_accounting_cptr const &get_io_accounting() const;
 
   virtual bool process();
 
@@ -169,6 +224,7 @@ public:
   virtual void close_file();
   virtual void reopen_file();
   virtual void reopen_file_for_writing();
+  virtual void flush_file();
   virtual mm_io_c &get_file() {
     return *m_file;
   }
@@ -183,25 +239,48 @@ public:
 protected:
   virtual void _log_debug_message(const std::string &message);
 
-  virtual void remove_from_meta_seeks(EbmlId id);
-  virtual void overwrite_all_instances(EbmlId id);
+  virtual update_element_result_e update_elements_in_transaction(std::vector<update_request_t> const &requests, EbmlElement *&current_element);
+  virtual update_element_result_e update_elements_internal(std::vector<update_request_t> const &requests, EbmlElement *&current_element);
+  virtual update_element_result_e update_elements_one_by_one(std::vector<update_request_t> const &requests, EbmlElement *&current_element);
+
+  virtual void remove_from_meta_seeks(std::vector<EbmlId> const &ids);
+  virtual void overwrite_all_instances(std::vector<EbmlId> const &ids, mbalgm::optional<uint64_t> const &position_to_keep = mbalgm::optional<uint64_t>{});
+  virtual bool can_write_before_overwriting(EbmlElement *e, bool write_defaults);
   virtual void merge_void_elements();
   virtual void write_element(EbmlElement *e, bool write_defaults, placement_strategy_e strategy);
-  virtual void add_to_meta_seek(EbmlElement *e);
-  virtual std::pair<bool, int> try_adding_to_existing_meta_seek(EbmlElement *e);
-  virtual void move_seek_head_to_end_and_create_new_one_at_start(EbmlElement *e, int first_seek_head_idx);
-  virtual bool create_new_meta_seek_at_start(EbmlElement *e);
+  virtual bool patch_element_in_place(EbmlElement *e, bool write_defaults);
+  virtual void add_to_meta_seek(std::vector<EbmlElement *> const &elements);
+  virtual std::pair<bool, int> try_adding_to_existing_meta_seek(std::vector<EbmlElement *> const &elements);
+  virtual void move_seek_head_to_end_and_create_new_one_at_start(std::vector<EbmlElement *> const &elements, int first_seek_head_idx);
+  virtual uint64_t copy_seek_head_to_end(size_t seek_head_idx, std::vector<EbmlElement *> const &elements);
+  virtual uint64_t render_seek_head_at_end(size_t seek_head_idx, std::vector<EbmlElement *> const &elements);
+  virtual bool create_new_meta_seek_at_start(std::vector<EbmlElement *> const &elements);
   virtual bool move_level1_element_before_cluster_to_end_of_file();
   virtual int ensure_front_seek_head_links_to(unsigned int seek_head_idx);
 
   virtual void adjust_segment_size();
   virtual bool handle_void_elements(size_t data_idx);
+  virtual bool shrink_size_field_of_next_element(size_t data_idx, EbmlElement &next_head);
+  virtual bool move_element_content_back_by_one_byte(size_t data_idx);
+  virtual bool copy_file_data(uint64_t source_pos, uint64_t destination_pos, uint64_t size);
+  virtual void update_meta_seeks_for_moved_element(size_t data_idx);
+  virtual ebml_element_cptr read_element_head(size_t data_idx);
+  virtual void load_lazy_payloads();
+  virtual void load_lazy_payloads(uint64_t start, uint64_t end);
+  virtual void load_lazy_payloads(std::vector<std::pair<uint64_t, uint64_t>> const &ranges);
+
+  virtual kax_analyzer_free_space_c &get_free_space();
+  virtual void invalidate_free_space();
+  virtual void free_space_added(size_t data_idx);
+  virtual void free_space_removed(size_t data_idx);
+  virtual mbalgm::optional<size_t> find_free_space(int64_t size, kax_analyzer_free_space_c::region_e region, bool allow_one_byte_remainder);
+  virtual mbalgm::optional<size_t> find_free_space_at_previous_position(EbmlId const &id, int64_t size);
 
   virtual bool analyzer_debugging_requested(const std::string &section);
   virtual void debug_dump_elements();
-  virtual void debug_dump_elements_maybe(const std::string &hook_name);
-  virtual void validate_data_structures(const std::string &hook_name);
-  virtual void verify_data_structures_against_file(const std::string &hook_name);
+  virtual void debug_dump_elements_maybe(char const *hook_name);
+  virtual void validate_data_structures(char const *hook_name);
+  virtual void verify_data_structures_against_file(char const *hook_name);
 
   virtual void read_all_meta_seeks();
   virtual void read_meta_seek(uint64_t pos, std::map<int64_t, bool> &positions_found);
@@ -210,8 +289,17 @@ protected:
 
   virtual void determine_webm();
 
+  virtual bool load_layout_cache();
+  virtual void save_layout_cache(memory_cptr const &segment_uid);
+  virtual bool revalidate_element(kax_analyzer_data_c const &data, bool allow_smaller_size);
+  virtual memory_cptr read_segment_uid();
+
 protected:
   virtual bool process_internal();
+  virtual bool skim_clusters(int64_t file_size);
+  virtual bool skim_clusters_in_parallel(mm_io_c &file, uint64_t &position, std::function<bool(uint64_t)> const &progress);
+
+  static bool skim_cluster_range(mm_io_c &file, kax_analyzer_index_c &index, uint64_t &position, uint64_t range_end, uint64_t segment_end, std::function<bool(uint64_t)> const &progress);
 };
 using kax_analyzer_cptr = std::shared_ptr<kax_analyzer_c>;
 
@@ -222,6 +310,7 @@ private:
 
 public:
   console_kax_analyzer_c(std::string file_name);
+  console_kax_analyzer_c(mm_io_c *file);
   virtual ~console_kax_analyzer_c();
 
   virtual void set_show_progress(bool show_progress);
@@ -0,0 +1,92 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   map of the free space (EbmlVoid elements) in a Matroska file
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include "common/kax_analyzer_free_space.h"
+
+void
+kax_analyzer_free_space_c::reset(uint64_t front_end) {
+  m_by_position.clear();
+  m_front_by_size.clear();
+  m_back_by_size.clear();
+
+  m_front_end = front_end;
+}
+
+kax_analyzer_free_space_c::by_size_t &
+kax_analyzer_free_space_c::by_size_for(uint64_t position) {
+  return position < m_front_end ? m_front_by_size : m_back_by_size;
+}
+
+void
+kax_analyzer_free_space_c::add(uint64_t position,
+                               int64_t size) {
+  remove(position);
+
+  m_by_position[position] = size;
+  by_size_for(position).emplace(size, position);
+}
+
+void
+kax_analyzer_free_space_c::remove(uint64_t position) {
+  auto itr = m_by_position.find(position);
+  if (itr == m_by_position.end())
+    return;
+
+  by_size_for(position).erase({ itr->second, position });
+  m_by_position.erase(itr);
+}
+
+/** \brief Finds the smallest area that can hold \c size bytes
+
+    An area that is exactly one byte larger than requested is only
+    used if there's no other choice: the remaining byte is too small
+    for an EbmlVoid element, and filling it requires moving the
+    following element's head which in turn triggers seek head updates.
+
+    Among areas of equal size the one closest to the start of the file
+    is returned.
+ */
+mbalgm::optional<uint64_t>
+kax_analyzer_free_space_c::find_in(by_size_t const &areas,
+                                   int64_t size,
+                                   bool allow_one_byte_remainder) {
+  auto itr = areas.lower_bound({ size, 0 });
+  if (itr == areas.end())
+    return {};
+
+  if (itr->first != (size + 1))
+    return itr->second;
+
+  auto larger = areas.lower_bound({ size + 2, 0 });
+  if (larger != areas.end())
+    return larger->second;
+
+  if (allow_one_byte_remainder)
+    return itr->second;
+
+  return {};
+}
+
+mbalgm::optional<uint64_t>
+kax_analyzer_free_space_c::find(int64_t size,
+                                region_e region,
+                                bool allow_one_byte_remainder)
+  const {
+  auto position = find_in(m_front_by_size, size, allow_one_byte_remainder);
+  if (position || (region_front == region))
+    return position;
+
+  return find_in(m_back_by_size, size, allow_one_byte_remainder);
+}
@@ -0,0 +1,54 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   map of the free space (EbmlVoid elements) in a Matroska file
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#pragma once
+
+#include "common/common_pch.h"
+
+/** \brief Index of the EbmlVoid elements at level 1
+
+    Each free area is recorded twice: once ordered by its position and
+    once ordered by its size. The size-ordered sets are split into the
+    areas located before the first cluster (the "front") and those
+    after it so that placement queries can prefer the front of the
+    file without having to look at the back at all.
+ */
+class kax_analyzer_free_space_c {
+public:
+  enum region_e {
+    region_anywhere,
+    region_front,
+  };
+
+protected:
+  using by_size_t = std::set<std::pair<int64_t, uint64_t> >;
+
+  std::map<uint64_t, int64_t> m_by_position;
+  by_size_t m_front_by_size, m_back_by_size;
+  uint64_t m_front_end{std::numeric_limits<uint64_t>::max()};
+
+public:
+  void reset(uint64_t front_end);
+  void add(uint64_t position, int64_t size);
+  void remove(uint64_t position);
+
+  mbalgm::optional<uint64_t> find(int64_t size, region_e region, bool allow_one_byte_remainder) const;
+
+  std::map<uint64_t, int64_t> const &get_areas() const {
+    return m_by_position;
+  }
+
+protected:
+  by_size_t &by_size_for(uint64_t position);
+  static mbalgm::optional<uint64_t> find_in(by_size_t const &areas, int64_t size, bool allow_one_byte_remainder);
+};
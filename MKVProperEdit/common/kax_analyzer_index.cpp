@@ -0,0 +1,230 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   compact index of a Matroska file's level 1 elements
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include <numeric>
+
+#include "common/kax_analyzer_index.h"
+
+EbmlId
+kax_analyzer_index_c::id_from_value(uint32_t value) {
+  // The length of an EBML ID is encoded in its first byte, which is
+  // never zero. Therefore the number of significant bytes is the
+  // ID's length.
+  auto length = 0xffffffu < value ? 4u
+              :   0xffffu < value ? 3u
+              :     0xffu < value ? 2u
+              :                     1u;
+
+  return EbmlId{value, length};
+}
+
+void
+kax_analyzer_index_c::set_id(size_t idx,
+                             EbmlId const &id) {
+  auto value = EBML_ID_VALUE(id);
+
+  if (m_ids[idx] == value)
+    return;
+
+  if (m_positions_by_id_valid) {
+    remove_position(m_ids[idx], m_records[idx].m_pos);
+    add_position(value, m_records[idx].m_pos);
+  }
+
+  m_ids[idx] = value;
+}
+
+void
+kax_analyzer_index_c::set_pos(size_t idx,
+                              uint64_t pos) {
+  if (m_positions_by_id_valid) {
+    remove_position(m_ids[idx], m_records[idx].m_pos);
+    add_position(m_ids[idx], pos);
+  }
+
+  m_records[idx].m_pos = pos;
+}
+
+void
+kax_analyzer_index_c::clear() {
+  m_records.clear();
+  m_ids.clear();
+  m_sizes_known.clear();
+
+  m_positions_by_id.clear();
+  m_positions_by_id_valid = false;
+}
+
+void
+kax_analyzer_index_c::reserve(size_t num_elements) {
+  m_records.reserve(num_elements);
+  m_ids.reserve(num_elements);
+  m_sizes_known.reserve(num_elements);
+}
+
+void
+kax_analyzer_index_c::push_back(EbmlId const &id,
+                                uint64_t pos,
+                                int64_t size,
+                                bool size_known) {
+  if (m_positions_by_id_valid)
+    add_position(EBML_ID_VALUE(id), pos);
+
+  m_records.push_back({ pos, size });
+  m_ids.push_back(EBML_ID_VALUE(id));
+  m_sizes_known.push_back(size_known);
+}
+
+void
+kax_analyzer_index_c::insert(size_t idx,
+                             EbmlId const &id,
+                             uint64_t pos,
+                             int64_t size,
+                             bool size_known) {
+  m_records.insert(m_records.begin() + idx, record_t{ pos, size });
+  m_ids.insert(m_ids.begin() + idx, EBML_ID_VALUE(id));
+  m_sizes_known.insert(m_sizes_known.begin() + idx, size_known);
+
+  if (m_positions_by_id_valid)
+    add_position(EBML_ID_VALUE(id), pos);
+}
+
+void
+kax_analyzer_index_c::erase(size_t first_idx,
+                            size_t last_idx) {
+  if (first_idx >= last_idx)
+    return;
+
+  if (m_positions_by_id_valid)
+    for (auto idx = first_idx; idx < last_idx; ++idx)
+      remove_position(m_ids[idx], m_records[idx].m_pos);
+
+  m_records.erase(m_records.begin() + first_idx, m_records.begin() + last_idx);
+  m_ids.erase(m_ids.begin() + first_idx, m_ids.begin() + last_idx);
+  m_sizes_known.erase(m_sizes_known.begin() + first_idx, m_sizes_known.begin() + last_idx);
+}
+
+void
+kax_analyzer_index_c::sort_by_position() {
+  auto num_elements = m_records.size();
+  auto order        = std::vector<size_t>(num_elements);
+
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return m_records[a].m_pos < m_records[b].m_pos; });
+
+  auto records     = std::vector<record_t>{};
+  auto ids         = std::vector<uint32_t>{};
+  auto sizes_known = std::vector<bool>{};
+
+  records.reserve(num_elements);
+  ids.reserve(num_elements);
+  sizes_known.reserve(num_elements);
+
+  for (auto idx : order) {
+    records.push_back(m_records[idx]);
+    ids.push_back(m_ids[idx]);
+    sizes_known.push_back(m_sizes_known[idx]);
+  }
+
+  m_records.swap(records);
+  m_ids.swap(ids);
+  m_sizes_known.swap(sizes_known);
+
+  // The positions themselves haven't changed. The secondary index
+  // stays valid.
+}
+
+void
+kax_analyzer_index_c::rebuild_positions_by_id()
+  const {
+  if (m_positions_by_id_valid)
+    return;
+
+  m_positions_by_id.clear();
+
+  for (auto idx = 0u, num_elements = static_cast<unsigned int>(m_ids.size()); idx < num_elements; ++idx)
+    m_positions_by_id[m_ids[idx]].push_back(m_records[idx].m_pos);
+
+  // The elements are usually sorted by their position already.
+  for (auto &id_and_positions : m_positions_by_id)
+    if (!std::is_sorted(id_and_positions.second.begin(), id_and_positions.second.end()))
+      std::sort(id_and_positions.second.begin(), id_and_positions.second.end());
+
+  m_positions_by_id_valid = true;
+}
+
+void
+kax_analyzer_index_c::add_position(uint32_t id_value,
+                                   uint64_t pos) {
+  auto &positions = m_positions_by_id[id_value];
+  positions.insert(std::upper_bound(positions.begin(), positions.end(), pos), pos);
+}
+
+void
+kax_analyzer_index_c::remove_position(uint32_t id_value,
+                                      uint64_t pos) {
+  auto &positions = m_positions_by_id[id_value];
+  auto itr        = std::lower_bound(positions.begin(), positions.end(), pos);
+
+  if ((itr != positions.end()) && (*itr == pos))
+    positions.erase(itr);
+}
+
+std::vector<size_t>
+kax_analyzer_index_c::find_all(EbmlId const &id)
+  const {
+  rebuild_positions_by_id();
+
+  std::vector<size_t> indexes;
+
+  auto itr = m_positions_by_id.find(EBML_ID_VALUE(id));
+  if (itr == m_positions_by_id.end())
+    return indexes;
+
+  indexes.reserve(itr->second.size());
+  for (auto pos : itr->second)
+    indexes.push_back(find_by_position(pos));
+
+  return indexes;
+}
+
+int
+kax_analyzer_index_c::find(EbmlId const &id)
+  const {
+  rebuild_positions_by_id();
+
+  auto itr = m_positions_by_id.find(EBML_ID_VALUE(id));
+  if ((itr == m_positions_by_id.end()) || itr->second.empty())
+    return -1;
+
+  return find_by_position(itr->second.front());
+}
+
+/** \brief Returns the index of the first element at \c pos
+
+    Relies on the elements being sorted by their position, which all
+    functions modifying the index maintain.
+
+    \return The element's index or -1 if no element starts at \c pos.
+ */
+int
+kax_analyzer_index_c::find_by_position(uint64_t pos)
+  const {
+  auto itr = std::lower_bound(m_records.begin(), m_records.end(), pos, [](record_t const &record, uint64_t wanted) { return record.m_pos < wanted; });
+  if ((itr == m_records.end()) || (itr->m_pos != pos))
+    return -1;
+
+  return static_cast<int>(std::distance(m_records.begin(), itr));
+}
@@ -0,0 +1,104 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   compact index of a Matroska file's level 1 elements
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#pragma once
+
+#include "common/common_pch.h"
+
+#include <unordered_map>
+
+#include <ebml/EbmlId.h>
+
+using namespace libebml;
+
+/** \brief Position, size and ID of all level 1 elements of a file
+
+    The records are stored in contiguous arrays instead of one heap
+    object per element. Files with hundreds of thousands of clusters
+    therefore only need a couple of large allocations.
+
+    Lookups by ID use a secondary index mapping each ID to the sorted
+    positions of the elements carrying it. The positions are mapped to
+    element indexes by a binary search. Contrary to indexes, positions
+    don't change when other elements are inserted or erased, e.g.
+    EbmlVoid elements during an update. Therefore each modification
+    only has to touch the list of the ID it affects. This relies on no
+    two elements sharing a position. The secondary index is built on
+    the first lookup and kept up to date afterwards.
+ */
+class kax_analyzer_index_c {
+protected:
+  struct record_t {
+    uint64_t m_pos;
+    int64_t m_size;
+  };
+
+  std::vector<record_t> m_records;
+  std::vector<uint32_t> m_ids;
+  std::vector<bool> m_sizes_known;
+
+  mutable std::unordered_map<uint32_t, std::vector<uint64_t> > m_positions_by_id;
+  mutable bool m_positions_by_id_valid{};
+
+public:
+  size_t size() const {
+    return m_records.size();
+  }
+  bool empty() const {
+    return m_records.empty();
+  }
+
+  EbmlId get_id(size_t idx) const {
+    return id_from_value(m_ids[idx]);
+  }
+  uint64_t get_pos(size_t idx) const {
+    return m_records[idx].m_pos;
+  }
+  int64_t get_size(size_t idx) const {
+    return m_records[idx].m_size;
+  }
+  bool is_size_known(size_t idx) const {
+    return m_sizes_known[idx];
+  }
+
+  void set_id(size_t idx, EbmlId const &id);
+  void set_pos(size_t idx, uint64_t pos);
+  void set_size(size_t idx, int64_t size) {
+    m_records[idx].m_size = size;
+  }
+  void set_size_known(size_t idx, bool size_known) {
+    m_sizes_known[idx] = size_known;
+  }
+
+  void clear();
+  void reserve(size_t num_elements);
+  void push_back(EbmlId const &id, uint64_t pos, int64_t size, bool size_known = true);
+  void insert(size_t idx, EbmlId const &id, uint64_t pos, int64_t size, bool size_known = true);
+  void erase(size_t first_idx, size_t last_idx);
+  void erase(size_t idx) {
+    erase(idx, idx + 1);
+  }
+
+  void sort_by_position();
+
+  int find(EbmlId const &id) const;
+  std::vector<size_t> find_all(EbmlId const &id) const;
+  int find_by_position(uint64_t pos) const;
+
+  static EbmlId id_from_value(uint32_t value);
+
+protected:
+  void rebuild_positions_by_id() const;
+  void add_position(uint32_t id_value, uint64_t pos);
+  void remove_position(uint32_t id_value, uint64_t pos);
+};
@@ -0,0 +1,207 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   persistent cache of a Matroska file's level 1 element layout
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include "common/checksums/base.h"
+#include "common/kax_analyzer_layout_cache.h"
+#include "common/mm_io_x.h"
+#include "common/mm_mmap_io.h"
+
+namespace {
+
+char const s_magic[8]            = { 'M', 'K', 'V', 'P', 'E', 'L', 'Y', 'T' };
+uint32_t const s_version         = 1;
+uint64_t const s_checksum_window = 4096;
+uint64_t const s_max_num_entries = 64 * 1024 * 1024;
+
+}
+
+bool
+kax_analyzer_layout_cache_c::key_t::matches_file(key_t const &other)
+  const {
+  return (m_file_size         == other.m_file_size)
+      && (m_modification_time == other.m_modification_time)
+      && (m_head_checksum     == other.m_head_checksum)
+      && (m_tail_checksum     == other.m_tail_checksum);
+}
+
+bool
+kax_analyzer_layout_cache_c::key_t::matches_segment_uid(memory_cptr const &segment_uid)
+  const {
+  if (!m_segment_uid || !segment_uid)
+    return !m_segment_uid && !segment_uid;
+
+  return *m_segment_uid == *segment_uid;
+}
+
+std::string
+kax_analyzer_layout_cache_c::get_cache_file_name_for(std::string const &file_name) {
+  return file_name + ".layout-cache";
+}
+
+uint32_t
+kax_analyzer_layout_cache_c::calculate_checksum(mm_io_c &file,
+                                               uint64_t position,
+                                               uint64_t size) {
+  auto buffer = memory_c::alloc(size);
+
+  file.setFilePointer(position);
+  if (file.read(buffer, size) != size)
+    throw mtx::mm_io::end_of_file_x{};
+
+  return mtx::checksum::calculate_as_uint(mtx::checksum::algorithm_e::crc32_ieee, *buffer);
+}
+
+kax_analyzer_layout_cache_c::key_t
+kax_analyzer_layout_cache_c::calculate_key(std::string const &file_name,
+                                           memory_cptr const &segment_uid) {
+  auto file_ptr = mm_mmap_io_c::open_for_reading(file_name);
+  auto &file    = *file_ptr;
+
+  key_t key;
+  auto window = std::min<uint64_t>(s_checksum_window, file.get_size());
+
+  key.m_file_size         = file.get_size();
+  key.m_modification_time = bfs::last_write_time(bfs::path{file_name});
+  key.m_segment_uid       = segment_uid;
+  key.m_head_checksum     = calculate_checksum(file, 0,                          window);
+  key.m_tail_checksum     = calculate_checksum(file, key.m_file_size - window, window);
+
+  return key;
+}
+
+bool
+kax_analyzer_layout_cache_c::load(std::string const &cache_file_name) {
+  m_data.clear();
+  m_meta_seek_positions.clear();
+
+  try {
+    if (!bfs::exists(bfs::path{cache_file_name}))
+      return false;
+
+    mm_file_io_c in{cache_file_name, MODE_READ};
+
+    char magic[sizeof(s_magic)];
+    if (   (in.read(magic, sizeof(magic)) != sizeof(magic))
+        || std::memcmp(magic, s_magic, sizeof(magic))
+        || (in.read_uint32_be() != s_version))
+      return false;
+
+    m_key.m_file_size         = in.read_uint64_be();
+    m_key.m_modification_time = in.read_uint64_be();
+    m_key.m_head_checksum     = in.read_uint32_be();
+    m_key.m_tail_checksum     = in.read_uint32_be();
+
+    auto uid_size = in.read_uint8();
+    if (uid_size) {
+      m_key.m_segment_uid = memory_c::alloc(uid_size);
+      if (in.read(m_key.m_segment_uid, uid_size) != uid_size)
+        return false;
+    }
+
+    m_segment_pos            = in.read_uint64_be();
+    m_segment_data_start_pos = in.read_uint64_be();
+    m_segment_end            = in.read_uint64_be();
+    m_parsed_fully           = !!in.read_uint8();
+
+    auto num_entries         = in.read_uint64_be();
+    if (num_entries > s_max_num_entries)
+      return false;
+
+    m_data.reserve(num_entries);
+
+    for (auto idx = 0ull; idx < num_entries; ++idx) {
+      auto id_value   = in.read_uint32_be();
+      auto id_length  = in.read_uint8();
+      auto pos        = in.read_uint64_be();
+      auto size       = static_cast<int64_t>(in.read_uint64_be());
+      auto size_known = !!in.read_uint8();
+
+      if ((1 > id_length) || (4 < id_length))
+        return false;
+
+      m_data.push_back(EbmlId{id_value, id_length}, pos, size, size_known);
+    }
+
+    auto num_meta_seeks = in.read_uint64_be();
+    if (num_meta_seeks > num_entries)
+      return false;
+
+    for (auto idx = 0ull; idx < num_meta_seeks; ++idx)
+      m_meta_seek_positions.push_back(in.read_uint64_be());
+
+  } catch (mtx::mm_io::exception &) {
+    m_data.clear();
+    return false;
+
+  } catch (bfs::filesystem_error &) {
+    return false;
+  }
+
+  return true;
+}
+
+void
+kax_analyzer_layout_cache_c::save(std::string const &cache_file_name)
+  const {
+  // Write to a temporary file first so that an interrupted run never
+  // leaves a truncated cache behind.
+  auto temp_file_name = cache_file_name + ".tmp";
+
+  {
+    mm_file_io_c out{temp_file_name, MODE_CREATE};
+
+    out.write(s_magic, sizeof(s_magic));
+    out.write_uint32_be(s_version);
+
+    out.write_uint64_be(m_key.m_file_size);
+    out.write_uint64_be(m_key.m_modification_time);
+    out.write_uint32_be(m_key.m_head_checksum);
+    out.write_uint32_be(m_key.m_tail_checksum);
+
+    auto uid_size = m_key.m_segment_uid ? std::min<size_t>(m_key.m_segment_uid->get_size(), 255) : 0;
+    out.write_uint8(uid_size);
+    if (uid_size)
+      out.write(m_key.m_segment_uid->get_buffer(), uid_size);
+
+    out.write_uint64_be(m_segment_pos);
+    out.write_uint64_be(m_segment_data_start_pos);
+    out.write_uint64_be(m_segment_end);
+    out.write_uint8(m_parsed_fully ? 1 : 0);
+
+    out.write_uint64_be(m_data.size());
+
+    for (auto idx = 0u; idx < m_data.size(); ++idx) {
+      auto id = m_data.get_id(idx);
+
+      out.write_uint32_be(EBML_ID_VALUE(id));
+      out.write_uint8(EBML_ID_LENGTH(id));
+      out.write_uint64_be(m_data.get_pos(idx));
+      out.write_uint64_be(m_data.get_size(idx));
+      out.write_uint8(m_data.is_size_known(idx) ? 1 : 0);
+    }
+
+    out.write_uint64_be(m_meta_seek_positions.size());
+    for (auto position : m_meta_seek_positions)
+      out.write_uint64_be(position);
+  }
+
+  bfs::rename(bfs::path{temp_file_name}, bfs::path{cache_file_name});
+}
+
+void
+kax_analyzer_layout_cache_c::remove(std::string const &cache_file_name) {
+  boost::system::error_code ec;
+  bfs::remove(bfs::path{cache_file_name}, ec);
+}
@@ -0,0 +1,49 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   persistent cache of a Matroska file's level 1 element layout
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#pragma once
+
+#include "common/common_pch.h"
+
+#include "common/kax_analyzer.h"
+
+class kax_analyzer_layout_cache_c {
+public:
+  struct key_t {
+    uint64_t m_file_size{};
+    int64_t m_modification_time{};
+    memory_cptr m_segment_uid;
+    uint32_t m_head_checksum{}, m_tail_checksum{};
+
+    bool matches_file(key_t const &other) const;
+    bool matches_segment_uid(memory_cptr const &segment_uid) const;
+  };
+
+  key_t m_key;
+  uint64_t m_segment_pos{}, m_segment_data_start_pos{}, m_segment_end{};
+  bool m_parsed_fully{};
+  kax_analyzer_index_c m_data;
+  std::vector<int64_t> m_meta_seek_positions;
+
+public:
+  bool load(std::string const &cache_file_name);
+  void save(std::string const &cache_file_name) const;
+
+public:
+  static std::string get_cache_file_name_for(std::string const &file_name);
+  static key_t calculate_key(std::string const &file_name, memory_cptr const &segment_uid);
+  static void remove(std::string const &cache_file_name);
+
+protected:
+  static uint32_t calculate_checksum(mm_io_c &file, uint64_t position, uint64_t size);
+};
@@ -22,6 +22,7 @@
 # include <libcharset.h>
 #endif
 #include <locale.h>
+#include <mutex>
 #if defined(SYS_WINDOWS)
 # include <windows.h>
 #endif
@@ -173,6 +174,11 @@ iconv_charset_converter_c::convert(iconv_t handle,
   if (s_iconv_t_error_value == handle)
     return source;
 
+  // iconv handles carry conversion state and must not be used by
+  // several threads at once.
+  static std::mutex s_mutex;
+  std::lock_guard<std::mutex> lock{s_mutex};
+
   int length        = source.length() * 4;
   char *destination = (char *)safemalloc(length + 1);
   memset(destination, 0, length + 1);
@@ -0,0 +1,253 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class counting the operations done on a file
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include "common/mm_accounting_io.h"
+
+namespace {
+
+std::string const s_default_phase{"other"};
+
+template<typename T>
+T
+timed(mm_io_accounting_cptr const &accounting,
+      std::function<T()> const &operation,
+      std::function<void(mm_io_accounting_c::counters_t &, T const &)> const &count) {
+  auto start  = std::chrono::steady_clock::now();
+  auto result = operation();
+  auto end    = std::chrono::steady_clock::now();
+
+  accounting->add([&](mm_io_accounting_c::counters_t &counters) {
+    counters.m_io_time += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    count(counters, result);
+  });
+
+  return result;
+}
+
+}
+
+mm_io_accounting_c::counters_t &
+mm_io_accounting_c::counters_t::operator +=(counters_t const &other) {
+  m_num_reads     += other.m_num_reads;
+  m_num_writes    += other.m_num_writes;
+  m_num_seeks     += other.m_num_seeks;
+  m_num_truncates += other.m_num_truncates;
+  m_num_flushes   += other.m_num_flushes;
+  m_bytes_read    += other.m_bytes_read;
+  m_bytes_written += other.m_bytes_written;
+  m_io_time       += other.m_io_time;
+  m_wall_time     += other.m_wall_time;
+  m_num_entered   += other.m_num_entered;
+
+  return *this;
+}
+
+nlohmann::json
+mm_io_accounting_c::counters_t::to_json()
+  const {
+  return nlohmann::json{
+    { "num_reads",     m_num_reads                                                                },
+    { "num_writes",    m_num_writes                                                               },
+    { "num_seeks",     m_num_seeks                                                                },
+    { "num_truncates", m_num_truncates                                                            },
+    { "num_flushes",   m_num_flushes                                                              },
+    { "bytes_read",    m_bytes_read                                                               },
+    { "bytes_written", m_bytes_written                                                            },
+    { "io_time_us",    std::chrono::duration_cast<std::chrono::microseconds>(m_io_time).count()   },
+    { "wall_time_us",  std::chrono::duration_cast<std::chrono::microseconds>(m_wall_time).count() },
+    { "num_entered",   m_num_entered                                                              },
+  };
+}
+
+mm_io_accounting_c::phase_c::phase_c(mm_io_accounting_cptr const &accounting,
+                                     std::string const &name)
+  : m_accounting{accounting}
+{
+  if (!m_accounting)
+    return;
+
+  m_previous_phase = m_accounting->enter_phase(name);
+  m_start          = std::chrono::steady_clock::now();
+}
+
+mm_io_accounting_c::phase_c::~phase_c() {
+  if (m_accounting)
+    m_accounting->leave_phase(m_previous_phase, std::chrono::steady_clock::now() - m_start);
+}
+
+mm_io_accounting_c::mm_io_accounting_c()
+  : m_current_phase{&m_phases[s_default_phase]}
+{
+}
+
+mm_io_accounting_c::counters_t *
+mm_io_accounting_c::enter_phase(std::string const &name) {
+  std::lock_guard<std::mutex> lock{m_mutex};
+
+  auto previous_phase = m_current_phase;
+  m_current_phase     = &m_phases[name];
+
+  if (m_current_phase != previous_phase)
+    ++m_current_phase->m_num_entered;
+
+  return previous_phase;
+}
+
+void
+mm_io_accounting_c::leave_phase(counters_t *previous_phase,
+                                std::chrono::nanoseconds duration) {
+  std::lock_guard<std::mutex> lock{m_mutex};
+
+  // Re-entering the active phase must not count its time twice.
+  if (m_current_phase != previous_phase)
+    m_current_phase->m_wall_time += duration;
+
+  m_current_phase = previous_phase;
+}
+
+void
+mm_io_accounting_c::add(std::function<void(counters_t &)> const &worker) {
+  std::lock_guard<std::mutex> lock{m_mutex};
+
+  worker(*m_current_phase);
+}
+
+void
+mm_io_accounting_c::reset() {
+  std::lock_guard<std::mutex> lock{m_mutex};
+
+  // The counters are reset in place as active phases keep pointers to
+  // their predecessors.
+  for (auto &phase : m_phases)
+    phase.second = counters_t{};
+}
+
+std::map<std::string, mm_io_accounting_c::counters_t>
+mm_io_accounting_c::get_phases()
+  const {
+  std::lock_guard<std::mutex> lock{m_mutex};
+
+  return m_phases;
+}
+
+mm_io_accounting_c::counters_t
+mm_io_accounting_c::get_total()
+  const {
+  counters_t total;
+
+  for (auto const &phase : get_phases())
+    total += phase.second;
+
+  // Wall times of nested phases overlap. Their sum is meaningless.
+  total.m_wall_time = std::chrono::nanoseconds{};
+
+  return total;
+}
+
+nlohmann::json
+mm_io_accounting_c::to_json()
+  const {
+  auto phases = nlohmann::json::object();
+
+  for (auto const &phase : get_phases())
+    phases[phase.first] = phase.second.to_json();
+
+  auto total = get_total().to_json();
+  total.erase("wall_time_us");
+  total.erase("num_entered");
+
+  return nlohmann::json{
+    { "phases", phases },
+    { "total",  total  },
+  };
+}
+
+// ------------------------------------------------------------
+
+mm_accounting_io_c::mm_accounting_io_c(mm_io_c *proxy_io,
+                                       mm_io_accounting_cptr const &accounting,
+                                       bool proxy_delete_io)
+  : mm_proxy_io_c(proxy_io, proxy_delete_io)
+  , m_accounting{accounting}
+{
+}
+
+mm_accounting_io_c::~mm_accounting_io_c() {
+}
+
+mm_io_accounting_cptr const &
+mm_accounting_io_c::get_accounting()
+  const {
+  return m_accounting;
+}
+
+void
+mm_accounting_io_c::setFilePointer(int64 offset,
+                                   seek_mode mode) {
+  auto previous_position = m_proxy_io->getFilePointer();
+
+  timed<uint64_t>(m_accounting,
+                  [this, offset, mode]() { m_proxy_io->setFilePointer(offset, mode); return m_proxy_io->getFilePointer(); },
+                  [previous_position](mm_io_accounting_c::counters_t &counters, uint64_t const &position) { counters.m_num_seeks += position != previous_position ? 1 : 0; });
+}
+
+int64_t
+mm_accounting_io_c::get_size() {
+  return m_proxy_io->get_size();
+}
+
+int
+mm_accounting_io_c::truncate(int64_t pos) {
+  m_cached_size = -1;
+
+  return timed<int>(m_accounting,
+                    [this, pos]() { return m_proxy_io->truncate(pos); },
+                    [](mm_io_accounting_c::counters_t &counters, int const &) { ++counters.m_num_truncates; });
+}
+
+void
+mm_accounting_io_c::flush() {
+  timed<bool>(m_accounting,
+              [this]() { m_proxy_io->flush(); return true; },
+              [](mm_io_accounting_c::counters_t &counters, bool const &) { ++counters.m_num_flushes; });
+}
+
+/** \brief Peeks at the proxied file and counts it as one read
+
+   The file pointer doesn't change, so no seek is counted.
+*/
+uint32
+mm_accounting_io_c::peek(void *buffer,
+                         size_t size) {
+  return timed<uint32>(m_accounting,
+                       [this, buffer, size]() { return m_proxy_io->peek(buffer, size); },
+                       [](mm_io_accounting_c::counters_t &counters, uint32 const &num_read) { ++counters.m_num_reads; counters.m_bytes_read += num_read; });
+}
+
+uint32
+mm_accounting_io_c::_read(void *buffer,
+                          size_t size) {
+  return timed<uint32>(m_accounting,
+                       [this, buffer, size]() { return m_proxy_io->read(buffer, size); },
+                       [](mm_io_accounting_c::counters_t &counters, uint32 const &num_read) { ++counters.m_num_reads; counters.m_bytes_read += num_read; });
+}
+
+size_t
+mm_accounting_io_c::_write(const void *buffer,
+                           size_t size) {
+  return timed<size_t>(m_accounting,
+                       [this, buffer, size]() { return mm_proxy_io_c::_write(buffer, size); },
+                       [](mm_io_accounting_c::counters_t &counters, size_t const &num_written) { ++counters.m_num_writes; counters.m_bytes_written += num_written; });
+}
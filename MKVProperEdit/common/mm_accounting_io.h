@@ -0,0 +1,118 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class counting the operations done on a file
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#pragma once
+
+#include "common/common_pch.h"
+
+#include <chrono>
+#include <mutex>
+
+#include "common/json.h"
+#include "common/mm_io.h"
+
+class mm_io_accounting_c;
+using mm_io_accounting_cptr = std::shared_ptr<mm_io_accounting_c>;
+
+/** \brief Operation counters attributed to named phases
+
+   Counters are collected by one or more \c mm_accounting_io_c
+   instances, all of which add to the phase that is currently
+   active. Phases are activated with \c phase_c objects for the
+   duration of a scope. Phases can be nested; operations are always
+   attributed to the innermost one. Operations done while no phase is
+   active are attributed to the phase named "other".
+
+   All functions may be called from several threads. Phases should
+   only be changed by a single thread, though.
+*/
+class mm_io_accounting_c {
+public:
+  struct counters_t {
+    uint64_t m_num_reads{}, m_num_writes{}, m_num_seeks{}, m_num_truncates{}, m_num_flushes{};
+    uint64_t m_bytes_read{}, m_bytes_written{};
+    // m_io_time is the time spent inside I/O operations. m_wall_time
+    // is the time the phase was active including all nested phases.
+    std::chrono::nanoseconds m_io_time{}, m_wall_time{};
+    unsigned int m_num_entered{};
+
+    counters_t &operator +=(counters_t const &other);
+    nlohmann::json to_json() const;
+  };
+
+  class phase_c {
+  protected:
+    mm_io_accounting_cptr m_accounting;
+    counters_t *m_previous_phase{};
+    std::chrono::steady_clock::time_point m_start;
+
+  public:
+    // A null accounting object turns the phase into a no-op.
+    phase_c(mm_io_accounting_cptr const &accounting, std::string const &name);
+    ~phase_c();
+
+    phase_c(phase_c const &) = delete;
+    phase_c &operator =(phase_c const &) = delete;
+  };
+
+protected:
+  mutable std::mutex m_mutex;
+  std::map<std::string, counters_t> m_phases;
+  counters_t *m_current_phase;
+
+public:
+  mm_io_accounting_c();
+
+  void add(std::function<void(counters_t &)> const &worker);
+  void reset();
+
+  std::map<std::string, counters_t> get_phases() const;
+  counters_t get_total() const;
+  nlohmann::json to_json() const;
+
+protected:
+  counters_t *enter_phase(std::string const &name);
+  void leave_phase(counters_t *previous_phase, std::chrono::nanoseconds duration);
+};
+
+/** \brief Counts the operations done on the proxied file
+
+   Reads, writes, truncations and flushes are counted together with
+   the number of bytes transferred and the time spent on them. Seeks
+   are only counted if they actually change the file position. The
+   counters are added to the currently active phase of an
+   \c mm_io_accounting_c instance which can be shared between several
+   files.
+*/
+class mm_accounting_io_c: public mm_proxy_io_c {
+protected:
+  mm_io_accounting_cptr m_accounting;
+
+public:
+  mm_accounting_io_c(mm_io_c *proxy_io, mm_io_accounting_cptr const &accounting, bool proxy_delete_io = true);
+  virtual ~mm_accounting_io_c();
+
+  virtual void setFilePointer(int64 offset, seek_mode mode = seek_beginning);
+  virtual int64_t get_size();
+  virtual int truncate(int64_t pos);
+  virtual void flush();
+  virtual uint32 peek(void *buffer, size_t size);
+
+  mm_io_accounting_cptr const &get_accounting() const;
+
+protected:
+  virtual uint32 _read(void *buffer, size_t size);
+  virtual size_t _write(const void *buffer, size_t size);
+};
+
+using mm_accounting_io_cptr = std::shared_ptr<mm_accounting_io_c>;
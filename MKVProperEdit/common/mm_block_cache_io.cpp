@@ -0,0 +1,348 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class caching blocks of files on high-latency storage
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include "common/mm_block_cache_io.h"
+#include "common/mm_io_x.h"
+
+mm_block_cache_io_c::mm_block_cache_io_c(std::string const &file_name,
+                                         uint64_t size,
+                                         callbacks_t const &callbacks,
+                                         size_t block_size,
+                                         size_t max_blocks)
+  : m_file_name{file_name}
+  , m_callbacks{callbacks}
+  , m_size{size}
+  , m_pos{}
+  , m_block_size{std::max<size_t>(block_size, 512)}
+  , m_max_blocks{std::max<size_t>(max_blocks, 1)}
+  , m_eof{}
+  , m_debug{"block_cache_io"}
+{
+}
+
+mm_block_cache_io_c::~mm_block_cache_io_c() {
+  close();
+}
+
+void
+mm_block_cache_io_c::close() {
+  // Background fetches reference the callbacks and must be finished
+  // before anything is released.
+  for (auto &pending : m_pending)
+    pending.second.m_result.wait();
+
+  m_pending.clear();
+  m_blocks.clear();
+  m_lru.clear();
+}
+
+mm_block_cache_io_c::statistics_t const &
+mm_block_cache_io_c::get_statistics()
+  const {
+  return m_statistics;
+}
+
+uint64
+mm_block_cache_io_c::getFilePointer() {
+  return m_pos;
+}
+
+void
+mm_block_cache_io_c::setFilePointer(int64 offset,
+                                    seek_mode mode) {
+  int64_t new_pos
+    = seek_beginning == mode ? offset
+    : seek_end       == mode ? static_cast<int64_t>(m_size) + offset // offsets from the end are negative already
+    :                          static_cast<int64_t>(m_pos)  + offset;
+
+  if (0 > new_pos)
+    throw mtx::mm_io::seek_x{};
+
+  m_pos              = new_pos;
+  m_current_position = new_pos;
+  m_eof              = false;
+}
+
+bool
+mm_block_cache_io_c::eof() {
+  return m_eof;
+}
+
+void
+mm_block_cache_io_c::clear_eof() {
+  m_eof = false;
+}
+
+int64_t
+mm_block_cache_io_c::get_size() {
+  return m_size;
+}
+
+mm_block_cache_io_c::block_t *
+mm_block_cache_io_c::find_block(uint64_t block) {
+  auto itr = m_blocks.find(block);
+  if (itr == m_blocks.end())
+    return nullptr;
+
+  m_lru.splice(m_lru.begin(), m_lru, itr->second.m_lru);
+
+  return &itr->second;
+}
+
+void
+mm_block_cache_io_c::add_blocks(uint64_t first_block,
+                                memory_cptr const &data,
+                                size_t fill) {
+  auto num_blocks = (data->get_size() + m_block_size - 1) / m_block_size;
+
+  for (auto idx = 0u; idx < num_blocks; ++idx) {
+    auto offset = idx * m_block_size;
+    auto block  = first_block + idx;
+
+    if (m_blocks.count(block))
+      continue;
+
+    auto &entry  = m_blocks[block];
+    entry.m_data = memory_c::clone(data->get_buffer() + offset, m_block_size);
+    entry.m_fill = offset < fill ? std::min(fill - offset, m_block_size) : 0;
+    m_lru.push_front(block);
+    entry.m_lru  = m_lru.begin();
+  }
+}
+
+void
+mm_block_cache_io_c::drop_least_recently_used_blocks() {
+  while (m_blocks.size() > m_max_blocks) {
+    m_blocks.erase(m_lru.back());
+    m_lru.pop_back();
+  }
+}
+
+bool
+mm_block_cache_io_c::wait_for_pending_fetch(uint64_t block) {
+  auto itr = m_pending.upper_bound(block);
+  if (itr == m_pending.begin())
+    return false;
+
+  --itr;
+  if (block >= (itr->first + itr->second.m_num_blocks))
+    return false;
+
+  auto result                       = itr->second.m_result.get();
+  m_statistics.m_num_fetched_bytes += result.second;
+
+  add_blocks(itr->first, result.first, result.second);
+  m_pending.erase(itr);
+
+  return true;
+}
+
+void
+mm_block_cache_io_c::wait_for_all_pending_fetches() {
+  while (!m_pending.empty())
+    wait_for_pending_fetch(m_pending.begin()->first);
+}
+
+/** \brief Makes sure that all blocks in the given range are cached
+
+   Runs of consecutive missing blocks are fetched with one call each.
+ */
+void
+mm_block_cache_io_c::fetch_blocks(uint64_t first_block,
+                                  uint64_t last_block) {
+  auto block = first_block;
+
+  while (block <= last_block) {
+    if (find_block(block) || wait_for_pending_fetch(block)) {
+      ++m_statistics.m_num_block_hits;
+      ++block;
+      continue;
+    }
+
+    auto run_end = block + 1;
+    while ((run_end <= last_block) && !m_blocks.count(run_end) && !wait_for_pending_fetch(run_end))
+      ++run_end;
+
+    auto num_blocks                   = run_end - block;
+    auto data                         = memory_c::alloc(num_blocks * m_block_size);
+    auto fill                         = m_callbacks.m_fetch(block * m_block_size, data->get_buffer(), data->get_size());
+
+    ++m_statistics.m_num_fetches;
+    m_statistics.m_num_fetched_bytes += fill;
+    m_statistics.m_num_block_misses  += num_blocks;
+
+    mxdebug_if(m_debug, strformat::bstr("fetched %1% blocks from %2%: %3% bytes\n") % num_blocks % (block * m_block_size) % fill);
+
+    add_blocks(block, data, fill);
+    block = run_end;
+  }
+}
+
+/** \brief Starts fetching the given range in the background
+ */
+void
+mm_block_cache_io_c::prefetch(uint64_t position,
+                              uint64_t size) {
+  if ((position >= m_size) || !size)
+    return;
+
+  size            = std::min(size, m_size - position);
+  auto block      = position / m_block_size;
+  auto last_block = (position + size - 1) / m_block_size;
+
+  while (block <= last_block) {
+    auto pending = m_pending.upper_bound(block);
+    auto covered = (pending != m_pending.begin()) && (block < (std::prev(pending)->first + std::prev(pending)->second.m_num_blocks));
+
+    if (covered || m_blocks.count(block)) {
+      ++block;
+      continue;
+    }
+
+    auto run_end = block + 1;
+    while ((run_end <= last_block) && !m_blocks.count(run_end) && !m_pending.count(run_end))
+      ++run_end;
+
+    auto num_blocks = run_end - block;
+    auto fetch      = m_callbacks.m_fetch;
+    auto run_start  = block * m_block_size;
+    auto run_size   = num_blocks * m_block_size;
+
+    m_pending[block].m_num_blocks = num_blocks;
+    m_pending[block].m_result     = std::async(std::launch::async, [fetch, run_start, run_size]() {
+      auto data = memory_c::alloc(run_size);
+      auto fill = fetch(run_start, data->get_buffer(), run_size);
+
+      return std::make_pair(data, fill);
+    });
+
+    ++m_statistics.m_num_fetches;
+    ++m_statistics.m_num_prefetches;
+    m_statistics.m_num_block_misses += num_blocks;
+
+    mxdebug_if(m_debug, strformat::bstr("prefetching %1% blocks from %2%\n") % num_blocks % run_start);
+
+    block = run_end;
+  }
+}
+
+uint32
+mm_block_cache_io_c::_read(void *buffer,
+                           size_t size) {
+  auto wanted = size;
+  size        = m_pos >= m_size ? 0 : std::min<uint64_t>(size, m_size - m_pos);
+
+  if (size)
+    fetch_blocks(m_pos / m_block_size, (m_pos + size - 1) / m_block_size);
+
+  auto dest     = static_cast<unsigned char *>(buffer);
+  size_t copied = 0;
+
+  while (copied < size) {
+    auto position = m_pos + copied;
+    auto block    = find_block(position / m_block_size);
+    auto offset   = position % m_block_size;
+
+    if (!block || (offset >= block->m_fill))
+      break;
+
+    auto num_bytes = std::min(size - copied, block->m_fill - offset);
+    std::memcpy(dest + copied, block->m_data->get_buffer() + offset, num_bytes);
+    copied += num_bytes;
+  }
+
+  drop_least_recently_used_blocks();
+
+  m_pos              += copied;
+  m_current_position  = m_pos;
+  m_eof               = copied < wanted;
+
+  return copied;
+}
+
+size_t
+mm_block_cache_io_c::_write(const void *buffer,
+                            size_t size) {
+  if (!m_callbacks.m_store)
+    throw mtx::mm_io::wrong_read_write_access_x();
+
+  if (!size)
+    return 0;
+
+  wait_for_all_pending_fetches();
+
+  auto source = static_cast<unsigned char const *>(buffer);
+
+  m_callbacks.m_store(m_pos, source, size);
+
+  ++m_statistics.m_num_stores;
+  m_statistics.m_num_stored_bytes += size;
+
+  // Keep the cached blocks up to date. Blocks that would end up with a
+  // gap are dropped instead.
+  auto end = m_pos + size;
+
+  for (auto block_idx = m_pos / m_block_size; (block_idx * m_block_size) < end; ++block_idx) {
+    auto itr = m_blocks.find(block_idx);
+    if (itr == m_blocks.end())
+      continue;
+
+    auto &block      = itr->second;
+    auto block_start = block_idx * m_block_size;
+    auto from        = std::max(m_pos, block_start) - block_start;
+    auto to          = std::min(end, block_start + m_block_size) - block_start;
+
+    if (from > block.m_fill) {
+      m_lru.erase(block.m_lru);
+      m_blocks.erase(itr);
+      continue;
+    }
+
+    std::memcpy(block.m_data->get_buffer() + from, source + (block_start + from - m_pos), to - from);
+    block.m_fill = std::max<size_t>(block.m_fill, to);
+  }
+
+  m_pos              = end;
+  m_current_position = m_pos;
+  m_size             = std::max(m_size, end);
+
+  return size;
+}
+
+int
+mm_block_cache_io_c::truncate(int64_t pos) {
+  if (!m_callbacks.m_truncate)
+    return -1;
+
+  wait_for_all_pending_fetches();
+
+  m_callbacks.m_truncate(pos);
+  m_size = pos;
+
+  for (auto itr = m_blocks.begin(); itr != m_blocks.end();) {
+    auto block_start = itr->first * m_block_size;
+
+    if (block_start >= m_size) {
+      m_lru.erase(itr->second.m_lru);
+      itr = m_blocks.erase(itr);
+      continue;
+    }
+
+    itr->second.m_fill = std::min<uint64_t>(itr->second.m_fill, m_size - block_start);
+    ++itr;
+  }
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class caching blocks of files on high-latency storage
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#pragma once
+
+#include "common/common_pch.h"
+
+#include <future>
+#include <list>
+
+#include "common/mm_io.h"
+
+/** \brief Block cache for files whose every access is expensive
+
+   The data is fetched from the storage through callbacks in blocks of
+   a fixed size. Adjacent blocks missing for one read are fetched with
+   a single call. The least recently used blocks are dropped once more
+   than the configured number of blocks are cached.
+
+   \c prefetch() starts fetching blocks in the background. A read
+   that needs a block being prefetched waits for that fetch instead of
+   issuing another one. Therefore the fetch callback must be callable
+   from several threads at the same time.
+
+   Writes are passed to the store callback immediately and update the
+   cached blocks. Without a store callback the file is read-only.
+*/
+class mm_block_cache_io_c: public mm_io_c {
+public:
+  struct callbacks_t {
+    std::function<size_t(uint64_t position, unsigned char *buffer, size_t size)> m_fetch;
+    std::function<void(uint64_t position, unsigned char const *buffer, size_t size)> m_store;
+    std::function<void(uint64_t size)> m_truncate;
+  };
+
+  struct statistics_t {
+    uint64_t m_num_fetches{}, m_num_fetched_bytes{}, m_num_stores{}, m_num_stored_bytes{};
+    uint64_t m_num_block_hits{}, m_num_block_misses{}, m_num_prefetches{};
+  };
+
+protected:
+  struct block_t {
+    memory_cptr m_data;
+    size_t m_fill{};
+    std::list<uint64_t>::iterator m_lru;
+  };
+
+  struct pending_fetch_t {
+    uint64_t m_num_blocks{};
+    std::future<std::pair<memory_cptr, size_t>> m_result;
+  };
+
+  std::string m_file_name;
+  callbacks_t m_callbacks;
+  uint64_t m_size, m_pos;
+  size_t m_block_size, m_max_blocks;
+  bool m_eof;
+
+  std::unordered_map<uint64_t, block_t> m_blocks;
+  std::list<uint64_t> m_lru;                       // block numbers, most recently used first
+  std::map<uint64_t, pending_fetch_t> m_pending;   // by the first block number
+
+  statistics_t m_statistics;
+  debugging_option_c m_debug;
+
+public:
+  mm_block_cache_io_c(std::string const &file_name, uint64_t size, callbacks_t const &callbacks, size_t block_size = 64 * 1024, size_t max_blocks = 1024);
+  virtual ~mm_block_cache_io_c();
+
+  virtual uint64 getFilePointer();
+  virtual void setFilePointer(int64 offset, seek_mode mode = seek_beginning);
+  virtual bool eof();
+  virtual void clear_eof();
+  virtual int64_t get_size();
+  virtual int truncate(int64_t pos);
+  virtual void close();
+  virtual std::string get_file_name() const {
+    return m_file_name;
+  }
+
+  virtual void prefetch(uint64_t position, uint64_t size);
+
+  statistics_t const &get_statistics() const;
+
+protected:
+  virtual uint32 _read(void *buffer, size_t size);
+  virtual size_t _write(const void *buffer, size_t size);
+
+  void fetch_blocks(uint64_t first_block, uint64_t last_block);
+  void add_blocks(uint64_t first_block, memory_cptr const &data, size_t fill);
+  block_t *find_block(uint64_t block);
+  bool wait_for_pending_fetch(uint64_t block);
+  void wait_for_all_pending_fetches();
+  void drop_least_recently_used_blocks();
+};
+
+using mm_block_cache_io_cptr = std::shared_ptr<mm_block_cache_io_c>;
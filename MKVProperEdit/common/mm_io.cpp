@@ -111,6 +111,25 @@ mm_file_io_c::_read(void *buffer,
   return bread;
 }
 
+/** \brief Reads from stdio's buffer and moves back there
+
+   Unlike the default implementation only one relative seek is done,
+   and the file pointer doesn't have to be queried afterwards.
+*/
+uint32
+mm_file_io_c::peek(void *buffer,
+                   size_t size) {
+  auto num_peeked = fread(buffer, 1, size, (FILE *)m_file);
+
+  if (num_peeked && (fseeko((FILE *)m_file, -static_cast<off_t>(num_peeked), SEEK_CUR) != 0))
+    throw mtx::mm_io::seek_x{mtx::mm_io::make_error_code()};
+
+  // Hitting the end while peeking must not show through eof().
+  clearerr((FILE *)m_file);
+
+  return num_peeked;
+}
+
 void
 mm_file_io_c::close() {
   if (m_file) {
@@ -797,6 +816,16 @@ mm_mem_io_c::setFilePointer(int64 offset,
     throw mtx::mm_io::seek_x{mtx::mm_io::make_error_code()};
 }
 
+uint32
+mm_mem_io_c::peek(void *buffer,
+                  size_t size) {
+  size_t pbytes = m_pos < m_mem_size ? std::min(size, m_mem_size - m_pos) : 0;
+  if (pbytes)
+    memcpy(buffer, m_read_only ? &m_ro_mem[m_pos] : &m_mem[m_pos], pbytes);
+
+  return pbytes;
+}
+
 uint32
 mm_mem_io_c::_read(void *buffer,
                    size_t size) {
@@ -114,6 +114,10 @@ public:
   virtual void enable_buffering(bool /* enable */) {
   }
 
+  // A hint that the given range will probably be read soon.
+  virtual void prefetch(uint64_t /* position */, uint64_t /* size */) {
+  }
+
 protected:
   virtual uint32 _read(void *buffer, size_t size) = 0;
   virtual size_t _write(const void *buffer, size_t size) = 0;
@@ -149,6 +153,9 @@ public:
   }
 
   virtual int truncate(int64_t pos);
+#if !defined(SYS_WINDOWS)
+  virtual uint32 peek(void *buffer, size_t size);
+#endif
 
   static void setup();
   static void cleanup();
@@ -195,6 +202,9 @@ public:
   virtual mm_io_c *get_proxied() const {
     return m_proxy_io;
   }
+  virtual void prefetch(uint64_t position, uint64_t size) {
+    m_proxy_io->prefetch(position, size);
+  }
 
 protected:
   virtual uint32 _read(void *buffer, size_t size);
@@ -252,6 +262,7 @@ public:
   virtual unsigned char *get_buffer() const;
   virtual unsigned char *get_and_lock_buffer();
   virtual std::string get_content() const;
+  virtual uint32 peek(void *buffer, size_t size);
 
 protected:
   virtual uint32 _read(void *buffer, size_t size);
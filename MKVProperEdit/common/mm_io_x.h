@@ -97,6 +97,15 @@ public:
   }
 };
 
+class transaction_too_large_x: public exception {
+public:
+  transaction_too_large_x(std::error_code const &error_code = std::error_code()) : exception(error_code) {}
+
+  virtual char const *what() const throw() {
+    return "too much data changed within a transaction";
+  }
+};
+
 class create_directory_x: public exception {
 protected:
   std::string m_path;
@@ -0,0 +1,162 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class for reading memory-mapped files
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#if !defined(SYS_WINDOWS)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include "common/mm_io_x.h"
+#include "common/mm_mmap_io.h"
+#include "common/mm_read_buffer_io.h"
+
+mm_mmap_io_c::mm_mmap_io_c(std::string const &path)
+  : m_file_name{path}
+  , m_mapping{}
+  , m_mapping_size{}
+  , m_pos{}
+  , m_fd{-1}
+{
+#if defined(SYS_WINDOWS)
+  throw mtx::mm_io::open_x{};
+
+#else
+  auto local_path = g_cc_local_utf8->native(path);
+  m_fd            = ::open(local_path.c_str(), O_RDONLY);
+
+  if (0 > m_fd)
+    throw mtx::mm_io::open_x{mtx::mm_io::make_error_code()};
+
+  struct stat st;
+  if ((0 != fstat(m_fd, &st)) || !S_ISREG(st.st_mode)) {
+    auto error_code = mtx::mm_io::make_error_code();
+    close();
+    throw mtx::mm_io::open_x{error_code};
+  }
+
+  m_mapping_size = st.st_size;
+
+  // Empty files cannot be mapped, but they can still be "read".
+  if (!m_mapping_size)
+    return;
+
+  auto mapping = mmap(nullptr, m_mapping_size, PROT_READ, MAP_SHARED, m_fd, 0);
+  if (MAP_FAILED == mapping) {
+    auto error_code = mtx::mm_io::make_error_code();
+    close();
+    throw mtx::mm_io::open_x{error_code};
+  }
+
+  m_mapping = static_cast<unsigned char const *>(mapping);
+#endif
+}
+
+mm_mmap_io_c::~mm_mmap_io_c() {
+  close();
+}
+
+void
+mm_mmap_io_c::close() {
+#if !defined(SYS_WINDOWS)
+  if (m_mapping)
+    munmap(const_cast<unsigned char *>(m_mapping), m_mapping_size);
+
+  if (0 <= m_fd)
+    ::close(m_fd);
+#endif
+
+  m_mapping      = nullptr;
+  m_mapping_size = 0;
+  m_pos          = 0;
+  m_fd           = -1;
+}
+
+uint64
+mm_mmap_io_c::getFilePointer() {
+  return m_pos;
+}
+
+void
+mm_mmap_io_c::setFilePointer(int64 offset,
+                             seek_mode mode) {
+  int64_t new_pos
+    = seek_beginning == mode ? offset
+    : seek_end       == mode ? static_cast<int64_t>(m_mapping_size) + offset // offsets from the end are negative already
+    :                          static_cast<int64_t>(m_pos)          + offset;
+
+  if ((0 > new_pos) || (static_cast<int64_t>(m_mapping_size) < new_pos))
+    throw mtx::mm_io::seek_x{};
+
+  m_pos              = new_pos;
+  m_current_position = new_pos;
+}
+
+bool
+mm_mmap_io_c::eof() {
+  return m_pos >= m_mapping_size;
+}
+
+int64_t
+mm_mmap_io_c::get_size() {
+  return m_mapping_size;
+}
+
+uint32
+mm_mmap_io_c::_read(void *buffer,
+                    size_t size) {
+  auto num_read = std::min<uint64_t>(size, m_mapping_size - m_pos);
+
+  if (num_read)
+    std::memcpy(buffer, m_mapping + m_pos, num_read);
+
+  m_pos              += num_read;
+  m_current_position  = m_pos;
+
+  return num_read;
+}
+
+uint32
+mm_mmap_io_c::peek(void *buffer,
+                   size_t size) {
+  auto num_peeked = std::min<uint64_t>(size, m_mapping_size - m_pos);
+
+  if (num_peeked)
+    std::memcpy(buffer, m_mapping + m_pos, num_peeked);
+
+  return num_peeked;
+}
+
+size_t
+mm_mmap_io_c::_write(const void *,
+                     size_t) {
+  throw mtx::mm_io::wrong_read_write_access_x();
+}
+
+/** \brief Opens a file for sequential or random reading
+
+   Maps the file if possible. Otherwise a buffered
+   \c mm_file_io_c is returned.
+*/
+mm_io_cptr
+mm_mmap_io_c::open_for_reading(std::string const &path) {
+  try {
+    return std::make_shared<mm_mmap_io_c>(path);
+  } catch (mtx::mm_io::open_x &) {
+  }
+
+  return std::make_shared<mm_read_buffer_io_c>(new mm_file_io_c{path, MODE_READ});
+}
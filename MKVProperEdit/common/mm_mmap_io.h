@@ -0,0 +1,58 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class for reading memory-mapped files
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#pragma once
+
+#include "common/common_pch.h"
+
+#include "common/mm_io.h"
+
+/** \brief Read-only access to a file through a memory mapping
+
+   Reading copies directly from the mapped pages without going through
+   stdio and without an additional read buffer.
+
+   Mapping is not supported on all platforms. In that case, and if the
+   file cannot be mapped, the constructor throws \c mtx::mm_io::open_x
+   so that the caller can fall back to \c mm_file_io_c.
+*/
+class mm_mmap_io_c: public mm_io_c {
+protected:
+  std::string m_file_name;
+  unsigned char const *m_mapping;
+  uint64_t m_mapping_size, m_pos;
+  int m_fd;
+
+public:
+  mm_mmap_io_c(std::string const &path);
+  virtual ~mm_mmap_io_c();
+
+  virtual uint64 getFilePointer();
+  virtual void setFilePointer(int64 offset, seek_mode mode = seek_beginning);
+  virtual bool eof();
+  virtual int64_t get_size();
+  virtual void close();
+  virtual std::string get_file_name() const {
+    return m_file_name;
+  }
+
+  virtual uint32 peek(void *buffer, size_t size);
+
+  static mm_io_cptr open_for_reading(std::string const &path);
+
+protected:
+  virtual uint32 _read(void *buffer, size_t size);
+  virtual size_t _write(const void *buffer, size_t size);
+};
+
+using mm_mmap_io_cptr = std::shared_ptr<mm_mmap_io_c>;
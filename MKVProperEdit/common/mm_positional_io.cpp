@@ -0,0 +1,216 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class for positional reads and writes with shared files
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#if !defined(SYS_WINDOWS)
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include "common/mm_io_x.h"
+#include "common/mm_positional_io.h"
+
+mm_positional_io_c::shared_file_t::~shared_file_t() {
+#if !defined(SYS_WINDOWS)
+  if (0 <= m_fd)
+    ::close(m_fd);
+#endif
+}
+
+mm_positional_io_c::mm_positional_io_c(std::string const &path,
+                                       open_mode const mode)
+  : m_file{std::make_shared<shared_file_t>()}
+  , m_pos{}
+  , m_eof{}
+{
+  m_file->m_file_name = path;
+
+#if defined(SYS_WINDOWS)
+  throw mtx::mm_io::open_x{};
+
+#else
+  int flags;
+
+  switch (mode) {
+    case MODE_READ:
+    case MODE_SAFE:
+      flags = O_RDONLY;
+      break;
+    case MODE_WRITE:
+      flags = O_RDWR;
+      break;
+    case MODE_CREATE:
+      flags = O_RDWR | O_CREAT | O_TRUNC;
+      break;
+    default:
+      throw mtx::invalid_parameter_x();
+  }
+
+  if ((MODE_WRITE == mode) || (MODE_CREATE == mode))
+    mm_file_io_c::prepare_path(path);
+
+  auto local_path = g_cc_local_utf8->native(path);
+
+  struct stat st;
+  if ((0 == stat(local_path.c_str(), &st)) && S_ISDIR(st.st_mode))
+    throw mtx::mm_io::open_x{mtx::mm_io::make_error_code()};
+
+  m_file->m_fd = ::open(local_path.c_str(), flags, 0666);
+
+  if (0 > m_file->m_fd)
+    throw mtx::mm_io::open_x{mtx::mm_io::make_error_code()};
+#endif
+}
+
+mm_positional_io_c::mm_positional_io_c(mm_positional_io_c const &other)
+  : mm_io_c{}
+  , m_file{other.m_file}
+  , m_pos{other.m_pos}
+  , m_eof{other.m_eof}
+{
+  m_current_position = m_pos;
+}
+
+mm_positional_io_c::~mm_positional_io_c() {
+  close();
+}
+
+/** \brief Creates another cursor at the same position sharing the file
+ */
+mm_positional_io_cptr
+mm_positional_io_c::clone()
+  const {
+  return std::make_shared<mm_positional_io_c>(*this);
+}
+
+void
+mm_positional_io_c::close() {
+  m_file.reset();
+}
+
+std::string
+mm_positional_io_c::get_file_name()
+  const {
+  return m_file ? m_file->m_file_name : std::string{};
+}
+
+uint64
+mm_positional_io_c::getFilePointer() {
+  return m_pos;
+}
+
+void
+mm_positional_io_c::setFilePointer(int64 offset,
+                                   seek_mode mode) {
+  int64_t new_pos
+    = seek_beginning == mode ? offset
+    : seek_end       == mode ? get_size()                   + offset // offsets from the end are negative already
+    :                          static_cast<int64_t>(m_pos) + offset;
+
+  if (0 > new_pos)
+    throw mtx::mm_io::seek_x{};
+
+  m_pos              = new_pos;
+  m_current_position = new_pos;
+  m_eof              = false;
+}
+
+bool
+mm_positional_io_c::eof() {
+  return m_eof;
+}
+
+void
+mm_positional_io_c::clear_eof() {
+  m_eof = false;
+}
+
+int64_t
+mm_positional_io_c::get_size() {
+#if !defined(SYS_WINDOWS)
+  // Other cursors may have written to the file. Therefore the size
+  // cannot be cached.
+  struct stat st;
+  if (m_file && (0 == fstat(m_file->m_fd, &st)))
+    return st.st_size;
+#endif
+
+  return -1;
+}
+
+int
+mm_positional_io_c::truncate(int64_t pos) {
+#if !defined(SYS_WINDOWS)
+  return m_file ? ftruncate(m_file->m_fd, pos) : -1;
+#else
+  return -1;
+#endif
+}
+
+uint32
+mm_positional_io_c::_read(void *buffer,
+                          size_t size) {
+  size_t num_read = 0;
+
+#if !defined(SYS_WINDOWS)
+  while (m_file && (num_read < size)) {
+    auto result = ::pread(m_file->m_fd, static_cast<unsigned char *>(buffer) + num_read, size - num_read, m_pos + num_read);
+
+    if ((0 > result) && (EINTR == errno))
+      continue;
+
+    if (0 > result)
+      throw mtx::mm_io::read_write_x{mtx::mm_io::make_error_code()};
+
+    if (!result)
+      break;
+
+    num_read += result;
+  }
+#endif
+
+  m_pos              += num_read;
+  m_current_position  = m_pos;
+  m_eof               = num_read < size;
+
+  return num_read;
+}
+
+size_t
+mm_positional_io_c::_write(const void *buffer,
+                           size_t size) {
+  size_t num_written = 0;
+
+#if !defined(SYS_WINDOWS)
+  while (m_file && (num_written < size)) {
+    auto result = ::pwrite(m_file->m_fd, static_cast<unsigned char const *>(buffer) + num_written, size - num_written, m_pos + num_written);
+
+    if ((0 > result) && (EINTR == errno))
+      continue;
+
+    if (0 >= result)
+      throw mtx::mm_io::read_write_x{mtx::mm_io::make_error_code()};
+
+    num_written += result;
+  }
+#endif
+
+  m_pos              += num_written;
+  m_current_position  = m_pos;
+  m_cached_size       = -1;
+
+  return num_written;
+}
@@ -0,0 +1,69 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class for positional reads and writes with shared files
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#pragma once
+
+#include "common/common_pch.h"
+
+#include "common/mm_io.h"
+
+class mm_positional_io_c;
+using mm_positional_io_cptr = std::shared_ptr<mm_positional_io_c>;
+
+/** \brief A cursor into a file that is shared with other cursors
+
+   Each object keeps its own file position and reads and writes with
+   \c pread and \c pwrite at that position. The underlying file
+   descriptor is shared by all cursors created from the same object
+   with \c clone() or with the copy constructor. It is closed once the
+   last of them is gone.
+
+   Different cursors may be used from different threads at the same
+   time. A single cursor must not be.
+
+   Positional I/O is not supported on all platforms. In that case the
+   constructor throws \c mtx::mm_io::open_x.
+*/
+class mm_positional_io_c: public mm_io_c {
+protected:
+  struct shared_file_t {
+    std::string m_file_name;
+    int m_fd{-1};
+
+    ~shared_file_t();
+  };
+
+  std::shared_ptr<shared_file_t> m_file;
+  uint64_t m_pos;
+  bool m_eof;
+
+public:
+  mm_positional_io_c(std::string const &path, open_mode const mode = MODE_READ);
+  mm_positional_io_c(mm_positional_io_c const &other);
+  virtual ~mm_positional_io_c();
+
+  virtual uint64 getFilePointer();
+  virtual void setFilePointer(int64 offset, seek_mode mode = seek_beginning);
+  virtual bool eof();
+  virtual void clear_eof();
+  virtual int64_t get_size();
+  virtual int truncate(int64_t pos);
+  virtual void close();
+  virtual std::string get_file_name() const;
+
+  virtual mm_positional_io_cptr clone() const;
+
+protected:
+  virtual uint32 _read(void *buffer, size_t size);
+  virtual size_t _write(const void *buffer, size_t size);
+};
@@ -31,6 +31,14 @@ mm_read_buffer_io_c::mm_read_buffer_io_c(mm_io_c *in,
   , m_buffering(true)
   , m_debug_seek{"read_buffer_io|read_buffer_io_read"}
   , m_debug_read{"read_buffer_io|read_buffer_io_read"}
+  , m_read_ahead{}
+  , m_ahead_offset{}
+  , m_num_sequential_refills{}
+  , m_ahead_requested{}
+  , m_ahead_fill{}
+  , m_ahead_pending{}
+  , m_ahead_done{}
+  , m_ahead_quit{}
 {
   setFilePointer(0, seek_beginning);
 }
@@ -39,6 +47,13 @@ mm_read_buffer_io_c::~mm_read_buffer_io_c() {
   close();
 }
 
+void
+mm_read_buffer_io_c::close() {
+  cancel_read_ahead();
+  stop_read_ahead_thread();
+  mm_proxy_io_c::close();
+}
+
 uint64
 mm_read_buffer_io_c::getFilePointer() {
   return m_buffering ? m_offset + m_cursor : m_proxy_io->getFilePointer();
@@ -84,6 +99,19 @@ mm_read_buffer_io_c::setFilePointer(int64 offset,
     return;
   }
 
+  // Short skips forward may land in the buffer read ahead.
+  if (use_read_ahead(new_pos))
+    return;
+
+  // Skipping less than a buffer forward, e.g. over the rest of an
+  // element, still counts as sequential access. Seeking anywhere else,
+  // especially backwards, doesn't.
+  auto buffer_end = m_offset + static_cast<int64_t>(m_fill);
+  if ((new_pos < buffer_end) || (new_pos >= (buffer_end + static_cast<int64_t>(m_size))))
+    m_num_sequential_refills = 0;
+
+  cancel_read_ahead();
+
   int64_t previous_pos = m_proxy_io->getFilePointer();
 
   // Actual seeking
@@ -101,7 +129,214 @@ mm_read_buffer_io_c::setFilePointer(int64 offset,
 
 int64_t
 mm_read_buffer_io_c::get_size() {
-  return m_proxy_io->get_size();
+  // The size is queried for each refill. While reading ahead the
+  // proxy must not be touched; the file is only read anyway.
+  if (m_read_ahead && (-1 != m_cached_size))
+    return m_cached_size;
+
+  cancel_read_ahead();
+
+  m_cached_size = m_proxy_io->get_size();
+
+  return m_cached_size;
+}
+
+/** \brief Enables or disables filling the next buffer in the background
+
+   Read-ahead only starts once the buffer has been refilled
+   sequentially a couple of times, and it stops on large backward
+   seeks. The proxied I/O object is then accessed from a background
+   thread while the current buffer is being consumed. It must therefore
+   not be used by anyone else while read-ahead is enabled. The thread
+   is started on first use and kept until read-ahead is disabled or
+   the object is closed.
+*/
+void
+mm_read_buffer_io_c::enable_read_ahead(bool enable) {
+  if (!enable) {
+    cancel_read_ahead();
+    stop_read_ahead_thread();
+  }
+
+  m_read_ahead = enable;
+
+  if (enable && !m_ahead_af_buffer)
+    m_ahead_af_buffer = memory_c::alloc(m_size);
+}
+
+void
+mm_read_buffer_io_c::start_read_ahead() {
+  if (!m_read_ahead || !m_buffering || m_ahead_pending || (2 > m_num_sequential_refills))
+    return;
+
+  m_ahead_offset = m_offset + m_fill;
+  auto avail     = std::min(get_size() - m_ahead_offset, static_cast<int64_t>(m_size));
+
+  if (0 >= avail)
+    return;
+
+  if (!m_ahead_thread.joinable())
+    m_ahead_thread = std::thread{[this]() { run_read_ahead_thread(); }};
+
+  // The proxy is positioned right behind the current buffer.
+  std::lock_guard<std::mutex> lock{m_ahead_mutex};
+
+  m_ahead_requested = avail;
+  m_ahead_done      = false;
+  m_ahead_pending   = true;
+
+  m_ahead_cond.notify_all();
+}
+
+/** \brief Reads ahead whenever asked to until the object is closed
+ */
+void
+mm_read_buffer_io_c::run_read_ahead_thread() {
+  std::unique_lock<std::mutex> lock{m_ahead_mutex};
+
+  while (true) {
+    m_ahead_cond.wait(lock, [this]() { return m_ahead_quit || m_ahead_requested; });
+
+    if (m_ahead_quit)
+      return;
+
+    auto size         = m_ahead_requested;
+    m_ahead_requested = 0;
+
+    lock.unlock();
+
+    size_t fill = 0;
+    std::exception_ptr error;
+
+    try {
+      fill = m_proxy_io->read(m_ahead_af_buffer->get_buffer(), size);
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    lock.lock();
+
+    m_ahead_fill  = fill;
+    m_ahead_error = error;
+    m_ahead_done  = true;
+
+    m_ahead_cond.notify_all();
+  }
+}
+
+/** \brief Waits for the pending read-ahead and returns the number of bytes read
+
+   Errors that occurred while reading ahead are re-thrown here.
+ */
+size_t
+mm_read_buffer_io_c::wait_for_read_ahead() {
+  std::unique_lock<std::mutex> lock{m_ahead_mutex};
+
+  m_ahead_cond.wait(lock, [this]() { return m_ahead_done; });
+
+  m_ahead_pending = false;
+
+  auto error    = m_ahead_error;
+  m_ahead_error = nullptr;
+
+  if (error)
+    std::rethrow_exception(error);
+
+  return m_ahead_fill;
+}
+
+void
+mm_read_buffer_io_c::stop_read_ahead_thread() {
+  if (!m_ahead_thread.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock{m_ahead_mutex};
+    m_ahead_quit = true;
+    m_ahead_cond.notify_all();
+  }
+
+  m_ahead_thread.join();
+  m_ahead_quit = false;
+}
+
+/** \brief Makes the buffer read ahead the current one if it contains \c position
+ */
+bool
+mm_read_buffer_io_c::use_read_ahead(int64_t position) {
+  if (!m_ahead_pending || (position < m_ahead_offset))
+    return false;
+
+  // A pending read-ahead is waited for only if its position is
+  // wanted. Otherwise the caller cancels it.
+  if (position >= (m_ahead_offset + static_cast<int64_t>(m_size)))
+    return false;
+
+  auto fill = wait_for_read_ahead();
+
+  mxdebug_if(m_debug_read, strformat::bstr("read-ahead from position %1% for %2% used\n") % m_ahead_offset % fill);
+
+  std::swap(m_af_buffer, m_ahead_af_buffer);
+  m_buffer = m_af_buffer->get_buffer();
+  m_offset = m_ahead_offset;
+  m_fill   = fill;
+  m_cursor = std::min<int64_t>(position - m_offset, m_fill);
+
+  if (m_fill != static_cast<size_t>(std::min(get_size() - m_offset, static_cast<int64_t>(m_size))))
+    m_eof = true;
+
+  start_read_ahead();
+
+  return true;
+}
+
+void
+mm_read_buffer_io_c::cancel_read_ahead() {
+  if (!m_ahead_pending)
+    return;
+
+  try {
+    wait_for_read_ahead();
+  } catch (...) {
+  }
+
+  // The proxy has been moved behind the buffer read ahead.
+  if (m_proxy_io)
+    m_proxy_io->setFilePointer(m_offset + m_fill, seek_beginning);
+}
+
+void
+mm_read_buffer_io_c::refill() {
+  // Refills only happen once the whole buffer has been consumed.
+  auto new_offset = m_offset + static_cast<int64_t>(m_fill);
+
+  ++m_num_sequential_refills;
+
+  if (use_read_ahead(new_offset))
+    return;
+
+  cancel_read_ahead();
+
+  m_offset = new_offset;
+  m_cursor = 0;
+  m_fill   = 0;
+  auto avail = std::min(get_size() - m_offset, static_cast<int64_t>(m_size));
+
+  if (0 >= avail) {
+    // must keep track of eof, as m_proxy_io->eof() will never be reached
+    // because of the above eof calculation
+    m_eof = true;
+    return;
+  }
+
+  int64_t previous_pos = m_proxy_io->getFilePointer();
+
+  m_fill = m_proxy_io->read(m_buffer, avail);
+  mxdebug_if(m_debug_read, strformat::bstr("physical read from position %3% for %1% returned %2%\n") % avail % m_fill % previous_pos);
+  if (m_fill != static_cast<size_t>(avail))
+    m_eof = true;
+
+  start_read_ahead();
 }
 
 uint32
@@ -124,34 +359,36 @@ mm_read_buffer_io_c::_read(void *buffer,
       m_cursor += avail;
 
     } else {
-      // Refill the buffer
-      m_offset += m_cursor;
-      m_cursor  = 0;
-      m_fill    = 0;
-      avail     = std::min(get_size() - m_offset, static_cast<int64_t>(m_size));
-
-      if (!avail) {
-        // must keep track of eof, as m_proxy_io->eof() will never be reached
-        // because of the above eof calculation
-        m_eof = true;
+      refill();
+      if (m_fill == m_cursor)
         break;
-      }
-
-      int64_t previous_pos = m_proxy_io->getFilePointer();
-
-      m_fill = m_proxy_io->read(m_buffer, avail);
-      mxdebug_if(m_debug_read, strformat::bstr("physical read from position %3% for %1% returned %2%\n") % avail % m_fill % previous_pos);
-      if (m_fill != avail) {
-        m_eof = true;
-        if (!m_fill)
-          break;
-      }
     }
   }
 
   return res;
 }
 
+/** \brief Copies data from the buffer without moving the file pointer
+
+   Only the data in the buffer is returned. The buffer is refilled if
+   it has been consumed completely.
+*/
+uint32
+mm_read_buffer_io_c::peek(void *buffer,
+                          size_t size) {
+  if (!m_buffering)
+    return mm_proxy_io_c::peek(buffer, size);
+
+  if (m_fill == m_cursor)
+    refill();
+
+  size_t avail = std::min(size, m_fill - m_cursor);
+  if (avail)
+    memcpy(buffer, m_buffer + m_cursor, avail);
+
+  return avail;
+}
+
 size_t
 mm_read_buffer_io_c::_write(const void *,
                             size_t) {
@@ -161,10 +398,16 @@ mm_read_buffer_io_c::_write(const void *,
 
 void
 mm_read_buffer_io_c::enable_buffering(bool enable) {
+  // The buffer is dropped, but the file pointer stays where it is.
+  auto position = getFilePointer();
+
+  cancel_read_ahead();
+  m_proxy_io->setFilePointer(position);
+
   m_buffering = enable;
-  if (!m_buffering) {
-    m_offset = 0;
-    m_cursor = 0;
-    m_fill   = 0;
-  }
+  m_offset    = position;
+  m_cursor    = 0;
+  m_fill      = 0;
+
+  m_num_sequential_refills = 0;
 }
@@ -16,6 +16,10 @@
 
 #include "common/common_pch.h"
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include "common/mm_io.h"
 
 class mm_read_buffer_io_c: public mm_proxy_io_c {
@@ -30,6 +34,22 @@ protected:
   bool m_buffering;
   debugging_option_c m_debug_seek, m_debug_read;
 
+  // Read-ahead: while the current buffer is consumed, the next one is
+  // filled by a background thread as long as the access is
+  // sequential. The thread is started once and lives until the object
+  // is closed. All members shared with it are protected by the mutex.
+  bool m_read_ahead;
+  memory_cptr m_ahead_af_buffer;
+  int64_t m_ahead_offset;
+  unsigned int m_num_sequential_refills;
+
+  std::thread m_ahead_thread;
+  std::mutex m_ahead_mutex;
+  std::condition_variable m_ahead_cond;
+  size_t m_ahead_requested, m_ahead_fill;
+  bool m_ahead_pending, m_ahead_done, m_ahead_quit;
+  std::exception_ptr m_ahead_error;
+
 public:
   mm_read_buffer_io_c(mm_io_c *in, size_t buffer_size = 1 << 17, bool delete_in = true);
   virtual ~mm_read_buffer_io_c();
@@ -40,8 +60,24 @@ public:
   inline virtual bool eof() { return m_eof; }
   virtual void clear_eof() { m_eof = false; }
   virtual void enable_buffering(bool enable);
+  virtual void enable_read_ahead(bool enable);
+  virtual void prefetch(uint64_t position, uint64_t size) {
+    // The proxy must not be touched while it is reading ahead.
+    if (!m_ahead_pending)
+      mm_proxy_io_c::prefetch(position, size);
+  }
+  virtual void close();
+  virtual uint32 peek(void *buffer, size_t size);
 
 protected:
+  virtual void start_read_ahead();
+  virtual bool use_read_ahead(int64_t position);
+  virtual void cancel_read_ahead();
+  virtual size_t wait_for_read_ahead();
+  virtual void stop_read_ahead_thread();
+  virtual void run_read_ahead_thread();
+  virtual void refill();
+
   virtual uint32 _read(void *buffer, size_t size);
   virtual size_t _write(const void *buffer, size_t size);
 };
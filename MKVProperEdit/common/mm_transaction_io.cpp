@@ -0,0 +1,255 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class keeping changes in memory until they're committed
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include "common/mm_io_x.h"
+#include "common/mm_transaction_io.h"
+
+mm_transaction_io_c::mm_transaction_io_c(mm_io_c *out,
+                                         size_t max_held_bytes)
+  : mm_write_back_io_c(out, max_held_bytes, false)
+{
+  reset();
+}
+
+mm_transaction_io_c::~mm_transaction_io_c() {
+  try {
+    close();
+  } catch (mtx::mm_io::exception &) {
+  }
+}
+
+void
+mm_transaction_io_c::reset() {
+  m_original_size  = m_proxy_io->get_size();
+  m_unchanged_size = m_original_size;
+  m_size           = m_original_size;
+  m_cached_size    = -1;
+}
+
+void
+mm_transaction_io_c::close() {
+  if (!m_proxy_io)
+    return;
+
+  rollback();
+  mm_proxy_io_c::close();
+}
+
+void
+mm_transaction_io_c::flush() {
+  // Nothing may reach the file before the transaction is committed.
+}
+
+int64_t
+mm_transaction_io_c::get_size() {
+  return m_size;
+}
+
+int
+mm_transaction_io_c::truncate(int64_t pos) {
+  clip_dirty_ranges(pos);
+
+  m_unchanged_size = std::min<uint64_t>(m_unchanged_size, pos);
+  m_size           = pos;
+  m_cached_size    = -1;
+
+  // Data that has already been passed on behind the original end
+  // would show up again if the file was extended later.
+  auto keep = std::max<uint64_t>(pos, m_original_size);
+  if (static_cast<uint64_t>(m_proxy_io->get_size()) > keep)
+    truncate_proxied(keep);
+
+  return 0;
+}
+
+size_t
+mm_transaction_io_c::_write(const void *buffer,
+                            size_t size) {
+  if (size)
+    m_size = std::max<uint64_t>(m_size, m_pos + size);
+
+  return mm_write_back_io_c::_write(buffer, size);
+}
+
+void
+mm_transaction_io_c::read_proxied(uint64_t position,
+                                  unsigned char *buffer,
+                                  size_t size) {
+  mm_write_back_io_c::read_proxied(position, buffer, size);
+
+  // Truncated parts of the original content read as zeros just like
+  // a hole behind the end of the file does.
+  auto start = std::max<uint64_t>(position,        m_unchanged_size);
+  auto end   = std::min<uint64_t>(position + size, m_original_size);
+
+  if (start < end)
+    std::memset(buffer + (start - position), 0, end - start);
+}
+
+/** \brief Passes on the data located behind the original end of the file
+
+   Called whenever more than the allowed amount of memory is in use.
+   Writing this data cannot destroy anything that the file contained
+   before. All other data has to stay in memory until the transaction
+   is committed.
+ */
+void
+mm_transaction_io_c::write_dirty_ranges() {
+  auto itr = m_dirty_ranges.upper_bound(m_original_size);
+  if (itr != m_dirty_ranges.begin()) {
+    auto previous = std::prev(itr);
+    if ((previous->first + previous->second.size()) > m_original_size)
+      itr = previous;
+  }
+
+  while (itr != m_dirty_ranges.end()) {
+    auto position = std::max<uint64_t>(itr->first, m_original_size);
+    auto data     = itr->second.data() + (position - itr->first);
+    auto size     = itr->second.size() - (position - itr->first);
+
+    m_proxy_io->setFilePointer(position);
+    if (m_proxy_io->write(data, size) != size)
+      throw mtx::mm_io::read_write_x{};
+
+    m_dirty_bytes -= size;
+
+    if (position == itr->first)
+      itr = m_dirty_ranges.erase(itr);
+
+    else {
+      itr->second.resize(position - itr->first);
+      ++itr;
+    }
+  }
+
+  invalidate_read_cache();
+
+  if (m_dirty_bytes > m_max_dirty_bytes)
+    throw mtx::mm_io::transaction_too_large_x{};
+}
+
+void
+mm_transaction_io_c::clip_dirty_ranges(uint64_t end) {
+  auto itr = m_dirty_ranges.lower_bound(end);
+
+  for (auto to_remove = itr; to_remove != m_dirty_ranges.end(); ++to_remove)
+    m_dirty_bytes -= to_remove->second.size();
+
+  m_dirty_ranges.erase(itr, m_dirty_ranges.end());
+
+  if (m_dirty_ranges.empty())
+    return;
+
+  auto &last = *m_dirty_ranges.rbegin();
+  if ((last.first + last.second.size()) > end) {
+    m_dirty_bytes -= last.first + last.second.size() - end;
+    last.second.resize(end - last.first);
+  }
+}
+
+/** \brief Zeros the truncated parts of the original content that are still inside the file
+
+   The file may have been extended again after having been truncated.
+   The original content in between must not reappear.
+ */
+void
+mm_transaction_io_c::fill_truncated_range() {
+  auto end      = std::min(m_original_size, m_size);
+  auto position = m_unchanged_size;
+
+  while (position < end) {
+    auto itr = m_dirty_ranges.upper_bound(position);
+
+    if (itr != m_dirty_ranges.begin()) {
+      auto previous     = std::prev(itr);
+      auto previous_end = previous->first + previous->second.size();
+
+      if (previous_end > position) {
+        position = previous_end;
+        continue;
+      }
+    }
+
+    auto gap_end = itr == m_dirty_ranges.end() ? end : std::min<uint64_t>(itr->first, end);
+    std::vector<unsigned char> zeros(gap_end - position);
+
+    add_dirty_range(position, zeros.data(), zeros.size());
+    position = gap_end;
+  }
+}
+
+void
+mm_transaction_io_c::truncate_proxied(uint64_t size) {
+  m_proxy_io->truncate(size);
+  m_cached_size = -1;
+  invalidate_read_cache();
+}
+
+/** \brief The parts of the original content that committing replaces
+
+   Each range is given by its start and end position. Whoever still
+   refers to the proxied file's content in these ranges has to read it
+   before \c commit() is called.
+ */
+std::vector<std::pair<uint64_t, uint64_t>>
+mm_transaction_io_c::get_changed_ranges()
+  const {
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+
+  for (auto const &range : m_dirty_ranges) {
+    if (range.first >= m_unchanged_size)
+      break;
+
+    ranges.emplace_back(range.first, std::min<uint64_t>(range.first + range.second.size(), m_unchanged_size));
+  }
+
+  if (m_unchanged_size < m_original_size)
+    ranges.emplace_back(m_unchanged_size, m_original_size);
+
+  return ranges;
+}
+
+/** \brief Writes all changes to the file
+
+   The ranges are written in the order of their positions. Afterwards
+   the file is truncated to its new size if that differs from its
+   current one. A new transaction starts with the file's new content.
+ */
+void
+mm_transaction_io_c::commit() {
+  fill_truncated_range();
+  mm_write_back_io_c::write_dirty_ranges();
+
+  if (static_cast<uint64_t>(m_proxy_io->get_size()) != m_size)
+    truncate_proxied(m_size);
+
+  reset();
+}
+
+/** \brief Discards all changes
+
+   Data already passed on behind the original end of the file is
+   removed again.
+ */
+void
+mm_transaction_io_c::rollback() {
+  m_dirty_ranges.clear();
+  m_dirty_bytes = 0;
+
+  if (static_cast<uint64_t>(m_proxy_io->get_size()) > m_original_size)
+    truncate_proxied(m_original_size);
+
+  reset();
+}
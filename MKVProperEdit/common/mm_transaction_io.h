@@ -0,0 +1,70 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class keeping changes in memory until they're committed
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#pragma once
+
+#include "common/common_pch.h"
+
+#include "common/mm_write_back_io.h"
+
+/** \brief Keeps all changes to a file in memory until they're committed
+
+   Writes are collected like in \c mm_write_back_io_c, and truncating
+   only changes the size of the file as seen through this object.
+   Nothing is written to the part of the file that existed when the
+   object was created until \c commit() is called. Then all ranges are
+   written in the order of their positions followed by at most one
+   call to the proxied file's \c truncate().
+
+   Data behind the original end of the file cannot destroy anything.
+   It is passed on to the proxied file as soon as more than the
+   configured amount of memory is in use. If the data inside the
+   original file alone needs more than that then writing throws
+   \c mtx::mm_io::transaction_too_large_x.
+
+   \c rollback() discards all changes, and so does destroying an
+   object without committing.
+*/
+class mm_transaction_io_c: public mm_write_back_io_c {
+protected:
+  // The size of the file when the transaction started, the size up
+  // to which the proxied file's original content is still valid and
+  // the size of the file as seen through this object.
+  uint64_t m_original_size, m_unchanged_size, m_size;
+
+public:
+  mm_transaction_io_c(mm_io_c *out, size_t max_held_bytes);
+  virtual ~mm_transaction_io_c();
+
+  virtual int64_t get_size();
+  virtual int truncate(int64_t pos);
+  virtual void flush();
+  virtual void close();
+
+  virtual void commit();
+  virtual void rollback();
+
+  virtual std::vector<std::pair<uint64_t, uint64_t>> get_changed_ranges() const;
+
+protected:
+  virtual size_t _write(const void *buffer, size_t size);
+
+  virtual void read_proxied(uint64_t position, unsigned char *buffer, size_t size);
+  virtual void write_dirty_ranges();
+  virtual void clip_dirty_ranges(uint64_t end);
+  virtual void fill_truncated_range();
+  virtual void truncate_proxied(uint64_t size);
+  virtual void reset();
+};
+
+using mm_transaction_io_cptr = std::shared_ptr<mm_transaction_io_c>;
@@ -0,0 +1,308 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class collecting scattered writes
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include "common/mm_io_x.h"
+#include "common/mm_write_back_io.h"
+
+namespace {
+
+// The amount of data read from the proxied file at once for small
+// reads.
+size_t const s_read_cache_size = 64 * 1024;
+
+}
+
+mm_write_back_io_c::mm_write_back_io_c(mm_io_c *out,
+                                       size_t max_dirty_bytes,
+                                       bool delete_out)
+  : mm_proxy_io_c(out, delete_out)
+  , m_dirty_bytes{}
+  , m_max_dirty_bytes{max_dirty_bytes}
+  , m_pos{out->getFilePointer()}
+  , m_eof{}
+  , m_debug{"write_back_io"}
+  , m_read_cache_start{}
+{
+}
+
+mm_write_back_io_c::~mm_write_back_io_c() {
+  // Errors cannot be reported from here. Users that care call flush()
+  // or close() themselves.
+  try {
+    close();
+  } catch (mtx::mm_io::exception &) {
+  }
+}
+
+void
+mm_write_back_io_c::close() {
+  if (!m_proxy_io)
+    return;
+
+  write_dirty_ranges();
+  invalidate_read_cache();
+  mm_proxy_io_c::close();
+}
+
+void
+mm_write_back_io_c::flush() {
+  write_dirty_ranges();
+  m_proxy_io->flush();
+}
+
+int
+mm_write_back_io_c::truncate(int64_t pos) {
+  write_dirty_ranges();
+  m_proxy_io->flush();
+  m_cached_size = -1;
+  invalidate_read_cache();
+
+  return m_proxy_io->truncate(pos);
+}
+
+uint64
+mm_write_back_io_c::getFilePointer() {
+  return m_pos;
+}
+
+void
+mm_write_back_io_c::setFilePointer(int64 offset,
+                                   seek_mode mode) {
+  int64_t new_pos
+    = seek_beginning == mode ? offset
+    : seek_end       == mode ? get_size()                   + offset // offsets from the end are negative already
+    :                          static_cast<int64_t>(m_pos) + offset;
+
+  if (0 > new_pos)
+    throw mtx::mm_io::seek_x{};
+
+  m_pos              = new_pos;
+  m_current_position = new_pos;
+  m_eof              = false;
+}
+
+bool
+mm_write_back_io_c::eof() {
+  return m_eof;
+}
+
+void
+mm_write_back_io_c::clear_eof() {
+  m_eof = false;
+}
+
+int64_t
+mm_write_back_io_c::get_size() {
+  int64_t size = m_proxy_io->get_size();
+
+  if (!m_dirty_ranges.empty()) {
+    auto const &last = *m_dirty_ranges.rbegin();
+    size             = std::max<int64_t>(size, last.first + last.second.size());
+  }
+
+  return size;
+}
+
+uint32
+mm_write_back_io_c::_read(void *buffer,
+                          size_t size) {
+  auto file_size = get_size();
+  auto wanted    = size;
+
+  if (static_cast<int64_t>(m_pos) >= file_size)
+    size = 0;
+  else
+    size = std::min<int64_t>(size, file_size - m_pos);
+
+  auto end  = m_pos + size;
+  auto dest = static_cast<unsigned char *>(buffer);
+
+  // Only go to the file if the request isn't covered by a single
+  // range completely.
+  auto itr  = m_dirty_ranges.upper_bound(m_pos);
+  if (itr != m_dirty_ranges.begin())
+    --itr;
+
+  auto covered = (itr != m_dirty_ranges.end()) && (itr->first <= m_pos) && ((itr->first + itr->second.size()) >= end);
+
+  if (size && !covered)
+    read_proxied(m_pos, dest, size);
+
+  for (; (itr != m_dirty_ranges.end()) && (itr->first < end); ++itr) {
+    auto range_start = std::max<uint64_t>(itr->first, m_pos);
+    auto range_end   = std::min<uint64_t>(itr->first + itr->second.size(), end);
+
+    if (range_start < range_end)
+      std::memcpy(dest + (range_start - m_pos), itr->second.data() + (range_start - itr->first), range_end - range_start);
+  }
+
+  m_pos              += size;
+  m_current_position  = m_pos;
+  m_eof               = size < wanted;
+
+  return size;
+}
+
+/** \brief Copies data without moving the file pointer
+
+   Like reading, this doesn't touch the proxied file if the data is
+   either held in memory or part of the block read last.
+*/
+uint32
+mm_write_back_io_c::peek(void *buffer,
+                         size_t size) {
+  auto position   = m_pos;
+  auto eof        = m_eof;
+  auto num_peeked = _read(buffer, size);
+
+  m_pos              = position;
+  m_current_position = position;
+  m_eof              = eof;
+
+  return num_peeked;
+}
+
+void
+mm_write_back_io_c::read_proxied(uint64_t position,
+                                 unsigned char *buffer,
+                                 size_t size) {
+  auto cache_end = m_read_cache_start + m_read_cache.size();
+
+  if ((position >= m_read_cache_start) && ((position + size) <= cache_end)) {
+    std::memcpy(buffer, &m_read_cache[position - m_read_cache_start], size);
+    return;
+  }
+
+  int64_t proxy_size = m_proxy_io->get_size();
+  size_t num_read    = 0;
+
+  if (static_cast<int64_t>(position) < proxy_size) {
+    if (m_proxy_io->getFilePointer() != position)
+      m_proxy_io->setFilePointer(position);
+
+    if (size < s_read_cache_size) {
+      m_read_cache.resize(std::min<int64_t>(s_read_cache_size, proxy_size - position));
+      m_read_cache.resize(m_proxy_io->read(m_read_cache.data(), m_read_cache.size()));
+      m_read_cache_start = position;
+
+      num_read = std::min(size, m_read_cache.size());
+      if (num_read)
+        std::memcpy(buffer, m_read_cache.data(), num_read);
+
+    } else
+      num_read = m_proxy_io->read(buffer, std::min<int64_t>(size, proxy_size - position));
+  }
+
+  // Anything behind the end of the proxied file that isn't written
+  // here is a hole that reads as zeros.
+  if (num_read < size)
+    std::memset(buffer + num_read, 0, size - num_read);
+}
+
+size_t
+mm_write_back_io_c::_write(const void *buffer,
+                           size_t size) {
+  if (!size)
+    return 0;
+
+  add_dirty_range(m_pos, static_cast<unsigned char const *>(buffer), size);
+
+  m_pos              += size;
+  m_current_position  = m_pos;
+  m_cached_size       = -1;
+
+  if (m_dirty_bytes > m_max_dirty_bytes)
+    write_dirty_ranges();
+
+  return size;
+}
+
+void
+mm_write_back_io_c::add_dirty_range(uint64_t position,
+                                    unsigned char const *data,
+                                    size_t size) {
+  auto end = position + size;
+
+  // Find the first range that overlaps with or touches the new one.
+  auto first = m_dirty_ranges.upper_bound(position);
+  if (first != m_dirty_ranges.begin()) {
+    auto previous = std::prev(first);
+    if ((previous->first + previous->second.size()) >= position)
+      first = previous;
+  }
+
+  auto last = first;
+  while ((last != m_dirty_ranges.end()) && (last->first <= end))
+    ++last;
+
+  if (first == last) {
+    m_dirty_ranges.emplace(position, std::vector<unsigned char>(data, data + size));
+    m_dirty_bytes += size;
+    return;
+  }
+
+  auto merged_start = std::min(position, first->first);
+  auto merged_end   = std::max(end, std::prev(last)->first + std::prev(last)->second.size());
+
+  for (auto itr = first; itr != last; ++itr)
+    m_dirty_bytes -= itr->second.size();
+
+  // Re-use the first range's memory if it starts the merged range so
+  // that appending to a range doesn't copy it each time.
+  std::vector<unsigned char> merged;
+  auto copy_from = first;
+  if (first->first == merged_start) {
+    merged = std::move(first->second);
+    ++copy_from;
+  }
+
+  merged.resize(merged_end - merged_start);
+
+  for (auto itr = copy_from; itr != last; ++itr)
+    std::memcpy(&merged[itr->first - merged_start], itr->second.data(), itr->second.size());
+
+  std::memcpy(&merged[position - merged_start], data, size);
+
+  m_dirty_ranges.erase(first, last);
+  m_dirty_bytes += merged.size();
+  m_dirty_ranges[merged_start] = std::move(merged);
+}
+
+void
+mm_write_back_io_c::write_dirty_ranges() {
+  if (m_dirty_ranges.empty())
+    return;
+
+  mxdebug_if(m_debug, strformat::bstr("writing %1% ranges with %2% bytes\n") % m_dirty_ranges.size() % m_dirty_bytes);
+
+  for (auto const &range : m_dirty_ranges) {
+    if (m_proxy_io->getFilePointer() != range.first)
+      m_proxy_io->setFilePointer(range.first);
+
+    if (m_proxy_io->write(range.second.data(), range.second.size()) != range.second.size())
+      throw mtx::mm_io::read_write_x{};
+  }
+
+  m_dirty_ranges.clear();
+  m_dirty_bytes = 0;
+
+  invalidate_read_cache();
+}
+
+void
+mm_write_back_io_c::invalidate_read_cache() {
+  m_read_cache.clear();
+  m_read_cache_start = 0;
+}
@@ -0,0 +1,70 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   IO callback class collecting scattered writes
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#pragma once
+
+#include "common/common_pch.h"
+
+#include "common/mm_io.h"
+
+/** \brief Collects small writes at arbitrary positions in memory
+
+   Written data is kept as a set of non-overlapping ranges. Writes that
+   overlap or touch an existing range are merged with it. Reads return
+   the written data even before it has reached the proxied file.
+
+   The ranges are written in the order of their positions on \c flush(),
+   \c truncate() and \c close(), or as soon as they occupy more than the
+   configured amount of memory.
+
+   Small reads from the proxied file are served from a block of it that
+   is kept in memory until the next write to or truncation of the
+   proxied file. Reading element heads one after the other therefore
+   doesn't have to seek in the proxied file each time.
+*/
+class mm_write_back_io_c: public mm_proxy_io_c {
+protected:
+  std::map<uint64_t, std::vector<unsigned char>> m_dirty_ranges;
+  size_t m_dirty_bytes, m_max_dirty_bytes;
+  uint64_t m_pos;
+  bool m_eof;
+  debugging_option_c m_debug;
+
+  std::vector<unsigned char> m_read_cache;
+  uint64_t m_read_cache_start;
+
+public:
+  mm_write_back_io_c(mm_io_c *out, size_t max_dirty_bytes = 4 * 1024 * 1024, bool delete_out = true);
+  virtual ~mm_write_back_io_c();
+
+  virtual uint64 getFilePointer();
+  virtual void setFilePointer(int64 offset, seek_mode mode = seek_beginning);
+  virtual bool eof();
+  virtual void clear_eof();
+  virtual int64_t get_size();
+  virtual int truncate(int64_t pos);
+  virtual void flush();
+  virtual void close();
+  virtual uint32 peek(void *buffer, size_t size);
+
+protected:
+  virtual uint32 _read(void *buffer, size_t size);
+  virtual size_t _write(const void *buffer, size_t size);
+
+  virtual void read_proxied(uint64_t position, unsigned char *buffer, size_t size);
+  virtual void add_dirty_range(uint64_t position, unsigned char const *data, size_t size);
+  virtual void write_dirty_ranges();
+  virtual void invalidate_read_cache();
+};
+
+using mm_write_back_io_cptr = std::shared_ptr<mm_write_back_io_c>;
@@ -39,6 +39,7 @@ charset_converter_cptr g_cc_stdio = charset_converter_cptr(new charset_converter
 std::shared_ptr<mm_io_c> g_mm_stdio   = std::shared_ptr<mm_io_c>(new mm_stdio_c);
 
 static mxmsg_handler_t s_mxmsg_info_handler, s_mxmsg_warning_handler, s_mxmsg_error_handler;
+static thread_local mxmsg_handler_t s_thread_mxmsg_info_handler, s_thread_mxmsg_warning_handler, s_thread_mxmsg_error_handler;
 static std::vector<std::string> s_warnings_emitted, s_errors_emitted;
 
 static nlohmann::json
@@ -103,6 +104,25 @@ set_mxmsg_handler(unsigned int level,
     assert(false);
 }
 
+/** \brief Overrides the message handler for the current thread only
+
+    Several independent jobs running in the same process use this for
+    collecting their messages separately. An empty \c handler reverts
+    to the process-wide handler set with \c set_mxmsg_handler.
+ */
+void
+set_thread_mxmsg_handler(unsigned int level,
+                         mxmsg_handler_t const &handler) {
+  if (MXMSG_INFO == level)
+    s_thread_mxmsg_info_handler = handler;
+  else if (MXMSG_WARNING == level)
+    s_thread_mxmsg_warning_handler = handler;
+  else if (MXMSG_ERROR == level)
+    s_thread_mxmsg_error_handler = handler;
+  else
+    assert(false);
+}
+
 void
 mxmsg(unsigned int level,
       std::string message) {
@@ -159,7 +179,9 @@ default_mxinfo(unsigned int,
 
 void
 mxinfo(std::string const &info) {
-  if (s_mxmsg_info_handler)
+  if (s_thread_mxmsg_info_handler)
+    s_thread_mxmsg_info_handler(MXMSG_INFO, info);
+  else if (s_mxmsg_info_handler)
     s_mxmsg_info_handler(MXMSG_INFO, info);
 }
 
@@ -186,7 +208,9 @@ default_mxwarn(unsigned int,
 
 void
 mxwarn(std::string const &warning) {
-  if (s_mxmsg_warning_handler)
+  if (s_thread_mxmsg_warning_handler)
+    s_thread_mxmsg_warning_handler(MXMSG_WARNING, warning);
+  else if (s_mxmsg_warning_handler)
     s_mxmsg_warning_handler(MXMSG_WARNING, warning);
 }
 
@@ -199,7 +223,9 @@ default_mxerror(unsigned int,
 
 void
 mxerror(std::string const &error) {
-  if (s_mxmsg_error_handler)
+  if (s_thread_mxmsg_error_handler)
+    s_thread_mxmsg_error_handler(MXMSG_ERROR, error);
+  else if (s_mxmsg_error_handler)
     s_mxmsg_error_handler(MXMSG_ERROR, error);
 }
 
@@ -0,0 +1,140 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   recording of timed spans in the Chrome trace event format
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#include "common/common_pch.h"
+
+#include <chrono>
+#include <mutex>
+
+#include "common/json.h"
+#include "common/mm_io.h"
+#include "common/tracing.h"
+
+namespace mtx { namespace tracing {
+
+std::atomic<bool> g_enabled{};
+
+namespace {
+
+struct event_t {
+  char const *m_name;
+  int64_t m_start, m_end;
+};
+
+// Each thread records into its own buffer. The buffers outlive their
+// threads so that spans of finished threads can still be written.
+struct thread_buffer_t {
+  unsigned int m_thread_id;
+  std::mutex m_mutex;
+  std::vector<event_t> m_events;
+
+  thread_buffer_t(unsigned int thread_id)
+    : m_thread_id{thread_id}
+  {
+  }
+};
+
+std::mutex s_mutex;
+std::vector<std::shared_ptr<thread_buffer_t>> s_buffers;
+thread_local std::shared_ptr<thread_buffer_t> s_thread_buffer;
+
+int64_t
+now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+thread_buffer_t &
+get_thread_buffer() {
+  if (!s_thread_buffer) {
+    std::lock_guard<std::mutex> lock{s_mutex};
+
+    s_thread_buffer = std::make_shared<thread_buffer_t>(s_buffers.size() + 1);
+    s_buffers.push_back(s_thread_buffer);
+  }
+
+  return *s_thread_buffer;
+}
+
+}
+
+void
+enable(bool enable) {
+  g_enabled = enable;
+}
+
+void
+clear() {
+  std::lock_guard<std::mutex> lock{s_mutex};
+
+  for (auto const &buffer : s_buffers) {
+    std::lock_guard<std::mutex> buffer_lock{buffer->m_mutex};
+    buffer->m_events.clear();
+  }
+}
+
+void
+span_c::begin(char const *name) {
+  m_name  = name;
+  m_start = now();
+}
+
+void
+span_c::end() {
+  auto end     = now();
+  auto &buffer = get_thread_buffer();
+
+  std::lock_guard<std::mutex> lock{buffer.m_mutex};
+  buffer.m_events.push_back({ m_name, m_start, end });
+}
+
+std::string
+get_chrome_json() {
+  auto events = nlohmann::json::array();
+  auto origin = std::numeric_limits<int64_t>::max();
+
+  std::lock_guard<std::mutex> lock{s_mutex};
+
+  for (auto const &buffer : s_buffers) {
+    std::lock_guard<std::mutex> buffer_lock{buffer->m_mutex};
+
+    for (auto const &event : buffer->m_events)
+      origin = std::min(origin, event.m_start);
+  }
+
+  // Timestamps are given in microseconds relative to the first span.
+  for (auto const &buffer : s_buffers) {
+    std::lock_guard<std::mutex> buffer_lock{buffer->m_mutex};
+
+    for (auto const &event : buffer->m_events)
+      events.push_back(nlohmann::json{
+        { "name", event.m_name                                            },
+        { "ph",   "X"                                                     },
+        { "ts",   static_cast<double>(event.m_start - origin) / 1000      },
+        { "dur",  static_cast<double>(event.m_end - event.m_start) / 1000 },
+        { "pid",  1                                                       },
+        { "tid",  buffer->m_thread_id                                     },
+      });
+  }
+
+  return mtx::json::dump(nlohmann::json{
+    { "traceEvents",     events },
+    { "displayTimeUnit", "ns"   },
+  });
+}
+
+void
+write_chrome_json(mm_io_c &out) {
+  out.puts(get_chrome_json() + "\n");
+}
+
+}}
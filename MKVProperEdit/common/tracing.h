@@ -0,0 +1,72 @@
+/*
+   mkvmerge -- utility for splicing together matroska files
+   from component media subtypes
+
+   Distributed under the GPL v2
+   see the file COPYING for details
+   or visit http://www.gnu.org/copyleft/gpl.html
+
+   recording of timed spans in the Chrome trace event format
+
+   Written by Moritz Bunkus <moritz@bunkus.org>.
+*/
+
+#pragma once
+
+#include "common/common_pch.h"
+
+#include <atomic>
+
+class mm_io_c;
+
+namespace mtx { namespace tracing {
+
+extern std::atomic<bool> g_enabled;
+
+void enable(bool enable);
+void clear();
+
+inline bool
+is_enabled() {
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+std::string get_chrome_json();
+void write_chrome_json(mm_io_c &out);
+
+/** \brief Records the time between its construction and destruction
+
+   Each span is recorded with nanosecond timestamps and the ID of the
+   thread that created it. Spans nest by time: a span created while
+   another one is alive on the same thread is shown as its child.
+
+   The name is not copied. It must stay valid until the trace has been
+   written, e.g. by being a string literal.
+
+   If tracing is disabled then a span costs a single check.
+*/
+class span_c {
+protected:
+  char const *m_name{};
+  int64_t m_start{};
+
+public:
+  explicit span_c(char const *name) {
+    if (is_enabled())
+      begin(name);
+  }
+
+  ~span_c() {
+    if (m_name)
+      end();
+  }
+
+  span_c(span_c const &) = delete;
+  span_c &operator =(span_c const &) = delete;
+
+protected:
+  void begin(char const *name);
+  void end();
+};
+
+}}
@@ -19,8 +19,10 @@
 //#include "common/random.h"
 #include "common/unique_numbers.h"
 
-static std::vector<uint64_t> s_random_unique_numbers[4];
-static std::unordered_map<unique_id_category_e, bool, mtx::hash<unique_id_category_e>> s_ignore_unique_numbers;
+// Each thread keeps its own lists so that independent jobs running
+// concurrently don't see each other's numbers.
+static thread_local std::vector<uint64_t> s_random_unique_numbers[4];
+static thread_local std::unordered_map<unique_id_category_e, bool, mtx::hash<unique_id_category_e>> s_ignore_unique_numbers;
 
 static void
 assert_valid_category(unique_id_category_e category) {
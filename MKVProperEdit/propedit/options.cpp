@@ -11,6 +11,9 @@
 
 #include "common/common_pch.h"
 
+#include "common/strings/editing.h"
+#include "common/strings/parsing.h"
+
 #include "propedit/options.h"
 #include "propedit/segment_info_target.h"
 #include "propedit/track_target.h"
@@ -19,10 +22,32 @@
 
 options_c::options_c()
   : m_show_progress(false)
+  , m_use_layout_cache(false)
   , m_parse_mode(kax_analyzer_c::parse_mode_fast)
+  , m_num_analysis_threads(1)
+  , m_num_jobs(0)
 {
 }
 
+/** \brief Copies the options and targets for editing another file
+
+   All changes have been parsed and validated already. The copies of
+   the targets are independent of the originals so that several
+   files can be edited concurrently.
+*/
+options_cptr
+options_c::clone_for(std::string const &file_name)
+  const {
+  auto copy         = std::make_shared<options_c>(*this);
+  copy->m_file_name = file_name;
+  copy->m_file_names.clear();
+
+  for (auto &target : copy->m_targets)
+    target = target->clone();
+
+  return copy;
+}
+
 void
 options_c::validate() {
   if (m_file_name.empty())
@@ -93,10 +118,10 @@ options_c::add_track_or_segmentinfo_target(std::string const &spec) {
 
 void
 options_c::set_file_name(const std::string &file_name) {
-  if (!m_file_name.empty())
-    mxerror(strformat::bstr(Y("More than one file name has been given ('%1%' and '%2%').\n")) % m_file_name % file_name);
+  if (m_file_name.empty())
+    m_file_name = file_name;
 
-  m_file_name = file_name;
+  m_file_names.push_back(file_name);
 }
 
 void
@@ -111,6 +136,19 @@ options_c::set_parse_mode(const std::string &parse_mode) {
     throw false;
 }
 
+void
+options_c::set_padding_policy(const std::string &spec) {
+  m_padding_policy = kax_analyzer_c::padding_policy_t{};
+
+  for (auto const &part : split(spec, ",")) {
+    auto ok = (!part.empty() && ('%' == part.back())) ? parse_number(part.substr(0, part.size() - 1), m_padding_policy.m_percentage)
+            :                                            parse_number(part, m_padding_policy.m_size);
+
+    if (!ok || (0 > m_padding_policy.m_size))
+      throw false;
+  }
+}
+
 void
 options_c::dump_info()
   const
@@ -118,10 +156,21 @@ options_c::dump_info()
   mxinfo(strformat::bstr("options:\n"
                        "  file_name:     %1%\n"
                        "  show_progress: %2%\n"
-                       "  parse_mode:    %3%\n")
+                       "  parse_mode:    %3%\n"
+                       "  layout_cache:  %4%\n"
+                       "  analysis_threads: %5%\n"
+                       "  padding:       %6% bytes, %7% percent\n"
+                       "  num_files:     %8%\n"
+                       "  jobs:          %9%\n")
          % m_file_name
          % m_show_progress
-         % static_cast<int>(m_parse_mode));
+         % static_cast<int>(m_parse_mode)
+         % m_use_layout_cache
+         % m_num_analysis_threads
+         % m_padding_policy.m_size
+         % m_padding_policy.m_percentage
+         % m_file_names.size()
+         % m_num_jobs);
 
   for (auto &target : m_targets)
     target->dump_info();
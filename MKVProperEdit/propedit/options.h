@@ -16,22 +16,30 @@
 #include "propedit/target.h"
 #include <ebml/EbmlMaster.h>
 
+class options_c;
+using options_cptr = std::shared_ptr<options_c>;
+
 class options_c {
 public:
   std::string m_file_name;
+  std::vector<std::string> m_file_names;
   std::vector<target_cptr> m_targets;
-  bool m_show_progress;
+  bool m_show_progress, m_use_layout_cache;
   kax_analyzer_c::parse_mode_e m_parse_mode;
+  unsigned int m_num_analysis_threads, m_num_jobs;
+  kax_analyzer_c::padding_policy_t m_padding_policy;
 
 public:
   options_c();
 
+  options_cptr clone_for(std::string const &file_name) const;
   void validate();
   void options_parsed();
 
   target_cptr add_track_or_segmentinfo_target(std::string const &spec);
   void set_file_name(const std::string &file_name);
   void set_parse_mode(const std::string &parse_mode);
+  void set_padding_policy(const std::string &spec);
   void dump_info() const;
   bool has_changes() const;
 
@@ -44,4 +52,3 @@ protected:
   void merge_targets();
   void prune_empty_masters();
 };
-using options_cptr = std::shared_ptr<options_c>;
@@ -11,14 +11,23 @@
 
 #include "common/common_pch.h"
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 #include <matroska/KaxChapters.h>
 #include <matroska/KaxInfo.h>
 #include <matroska/KaxTags.h>
 #include <matroska/KaxTracks.h>
 
+#include "common/at_scope_exit.h"
 #include "common/command_line.h"
+#include "common/json.h"
 #include "common/list_utils.h"
+#include "common/mm_accounting_io.h"
 #include "common/mm_io_x.h"
+#include "common/strings/editing.h"
+#include "common/tracing.h"
 #include "common/unique_numbers.h"
 #include "common/version.h"
 #include "propedit/propedit_cli_parser.h"
@@ -82,6 +91,8 @@ has_content_been_modified(options_cptr const &options) {
 static void
 write_changes(options_cptr &options,
               kax_analyzer_c *analyzer) {
+  mtx::tracing::span_c span{"write_changes"};
+
   std::vector<EbmlId> ids_to_write;
   ids_to_write.push_back(KaxInfo::ClassInfos.GlobalId);
   ids_to_write.push_back(KaxTracks::ClassInfos.GlobalId);
@@ -89,6 +100,10 @@ write_changes(options_cptr &options,
   ids_to_write.push_back(KaxChapters::ClassInfos.GlobalId);
   ids_to_write.push_back(KaxAttachments::ClassInfos.GlobalId);
 
+  // Collect all modified level 1 elements first so that the analyzer
+  // can update the file in a single pass.
+  std::vector<kax_analyzer_c::update_request_t> requests;
+
   for (auto &id_to_write : ids_to_write) {
     for (auto &target : options->m_targets) {
       if (!target->get_level1_element())
@@ -101,25 +116,89 @@ write_changes(options_cptr &options,
 
       mxverb(2, strformat::bstr(Y("Element %1% is written.\n")) % l1_element.Generic().DebugName);
 
-      auto result = l1_element.ListSize() ? analyzer->update_element(&l1_element, target->write_elements_set_to_default_value(), target->add_mandatory_elements_if_missing())
-                  :                         analyzer->remove_elements(EbmlId(l1_element));
-      if (kax_analyzer_c::uer_success != result)
-        display_update_element_result(l1_element.Generic(), result);
+      requests.push_back({ &l1_element, target->write_elements_set_to_default_value(), target->add_mandatory_elements_if_missing(), !l1_element.ListSize() });
 
       break;
     }
   }
+
+  if (requests.empty())
+    return;
+
+  EbmlElement *failed_element = nullptr;
+  auto result                 = analyzer->update_elements(requests, &failed_element);
+  if (kax_analyzer_c::uer_success != result)
+    display_update_element_result((failed_element ? failed_element : requests.front().m_element)->Generic(), result);
+
+  auto const &statistics = analyzer->get_placement_statistics();
+  mxverb(2,
+         strformat::bstr(Y("Elements written: %1%; patched: %2%; in place: %3%; elsewhere in the file: %4%; at the end: %5%; with padding: %6% (%7% bytes).\n"))
+         % statistics.m_num_written % statistics.m_num_patched % statistics.m_num_in_place % statistics.m_num_in_free_space % statistics.m_num_at_end
+         % statistics.m_num_padded % statistics.m_padding_reserved);
 }
 
+// The I/O accounting of the edit running on this thread. Errors
+// terminate the process without unwinding the stack, therefore it is
+// also reported right before exiting.
+static thread_local mm_io_accounting_cptr s_io_accounting;
+
+/** \brief Reports the I/O operations done by the analyzer per phase
+
+   Enabled with "--debug io_accounting". The counters are written as
+   JSON to the file given as the option's value or to the standard
+   output if no value is given. They are reported once per edit
+   whether it succeeds or fails.
+*/
 static void
+display_io_accounting() {
+  auto accounting = s_io_accounting;
+  if (!accounting)
+    return;
+
+  s_io_accounting.reset();
+
+  std::string file_name;
+  debugging_c::requested("io_accounting", &file_name);
+
+  auto json = mtx::json::dump(accounting->to_json(), 2);
+
+  if (file_name.empty()) {
+    mxinfo(strformat::bstr("%1%\n") % json);
+    return;
+  }
+
+  try {
+    mm_file_io_c out{file_name, MODE_CREATE};
+    out.puts(json + "\n");
+
+  } catch (mtx::mm_io::exception &ex) {
+    mxwarn(strformat::bstr("The I/O accounting could not be written to '%1%': %2%\n") % file_name % ex);
+  }
+}
+
+static mtx::propedit::file_opener_t s_file_opener;
+
+static bool
 run(options_cptr &options) {
+  mtx::tracing::span_c run_span{"run"};
+
+  // The file must outlive the analyzer that uses it.
+  mm_io_cptr file;
   console_kax_analyzer_cptr analyzer;
 
   try {
+    mtx::tracing::span_c probe_span{"probe"};
+
     if (!kax_analyzer_c::probe(options->m_file_name))
       mxerror(strformat::bstr("The file '%1%' is not a Matroska file or it could not be found.\n") % options->m_file_name);
 
-    analyzer = console_kax_analyzer_cptr(new console_kax_analyzer_c(options->m_file_name));
+    if (s_file_opener)
+      file = s_file_opener(options->m_file_name);
+
+    if (file)
+      analyzer = console_kax_analyzer_cptr(new console_kax_analyzer_c(file.get()));
+    else
+      analyzer = console_kax_analyzer_cptr(new console_kax_analyzer_c(options->m_file_name));
   } catch (mtx::mm_io::exception &ex) {
     mxerror(strformat::bstr("The file '%1%' could not be opened for reading and writing: %1.\n") % options->m_file_name % ex);
   }
@@ -127,11 +206,19 @@ run(options_cptr &options) {
   mxinfo(strformat::bstr("%1%\n") % Y("The file is being analyzed."));
 
   analyzer->set_show_progress(options->m_show_progress);
+  analyzer->set_io_accounting(debugging_c::requested("io_accounting"));
+
+  s_io_accounting = analyzer->get_io_accounting();
+  mtx::at_scope_exit_c report_io_accounting([]() { display_io_accounting(); });
 
   bool ok = false;
   try {
     ok = analyzer
       ->set_parse_mode(options->m_parse_mode)
+      .set_layout_cache(options->m_use_layout_cache)
+      .set_analysis_threads(options->m_num_analysis_threads)
+      .set_padding_policy(options->m_padding_policy)
+      .set_lazy_payloads(true)
       .set_open_mode(MODE_WRITE)
       .set_throw_on_error(true)
       .process();
@@ -143,34 +230,221 @@ run(options_cptr &options) {
   if (!ok)
     mxerror(Y("This file could not be opened or parsed.\n"));
 
-  options->find_elements(analyzer.get());
-  options->validate();
+  {
+    mtx::tracing::span_c span{"find_elements"};
+    options->find_elements(analyzer.get());
+  }
+
+  {
+    mtx::tracing::span_c span{"validate"};
+    options->validate();
+  }
 
   if (debugging_c::requested("dump_options")) {
     mxinfo("\nDumping options after file and element analysis\n\n");
     options->dump_info();
   }
 
-  options->execute(*analyzer);
+  {
+    mtx::tracing::span_c span{"execute"};
+    options->execute(*analyzer);
+  }
 
   if (has_content_been_modified(options)) {
     mxinfo(Y("The changes are written to the file.\n"));
 
     write_changes(options, analyzer.get());
+    display_io_accounting();
 
     mxinfo(Y("Done.\n"));
 
-  } else
-    mxinfo(Y("No changes were made.\n"));
+    return true;
+  }
+
+  display_io_accounting();
+
+  mxinfo(Y("No changes were made.\n"));
+
+  return false;
+}
+
+/** \brief Runs \c code with all messages routed to the calling thread's job
+
+   Informational messages and warnings are appended to \c messages and
+   \c warnings. Errors are thrown as \c edit_error_x instead of
+   terminating the process.
+*/
+static void
+run_in_job_context(unsigned int verbosity,
+                   std::vector<std::string> &messages,
+                   std::vector<std::string> &warnings,
+                   std::function<void()> const &code) {
+  auto previous_verbose = verbose;
+  verbose               = verbosity;
+
+  set_thread_mxmsg_handler(MXMSG_INFO,    [&messages](unsigned int, std::string const &message) { messages.push_back(message); });
+  set_thread_mxmsg_handler(MXMSG_WARNING, [&warnings](unsigned int, std::string const &message) { warnings.push_back(message); });
+  set_thread_mxmsg_handler(MXMSG_ERROR,   [](unsigned int, std::string const &message) { throw mtx::propedit::edit_error_x{message}; });
+
+  mtx::at_scope_exit_c restore([previous_verbose]() {
+    set_thread_mxmsg_handler(MXMSG_INFO,    {});
+    set_thread_mxmsg_handler(MXMSG_WARNING, {});
+    set_thread_mxmsg_handler(MXMSG_ERROR,   {});
+    verbose = previous_verbose;
+  });
+
+  clear_list_of_unique_numbers(UNIQUE_ALL_IDS);
+
+  try {
+    code();
+
+  } catch (mtx::propedit::edit_error_x &) {
+    throw;
+
+  } catch (mtx::exception &ex) {
+    throw mtx::propedit::edit_error_x{ex.what()};
+  }
+}
+
+struct batch_result_t {
+  enum status_e {
+    bs_unchanged,
+    bs_modified,
+    bs_failed,
+  };
+
+  status_e m_status{bs_failed};
+  std::string m_error;
+  std::vector<std::string> m_messages, m_warnings;
+};
+
+static void
+display_batch_results(options_cptr const &options,
+                      std::vector<batch_result_t> const &results) {
+  auto num_modified = 0u, num_failed = 0u;
+
+  for (auto idx = 0u; idx < results.size(); ++idx) {
+    auto const &result = results[idx];
+    auto status        = batch_result_t::bs_modified  == result.m_status ? Y("modified")
+                       : batch_result_t::bs_unchanged == result.m_status ? Y("no changes were made")
+                       :                                                   Y("failed");
+
+    mxinfo(strformat::bstr(Y("'%1%': %2%\n")) % options->m_file_names[idx] % status);
+
+    if (1 < verbose)
+      for (auto const &message : result.m_messages)
+        mxinfo(strformat::bstr("  %1%") % message);
+
+    for (auto const &warning : result.m_warnings)
+      mxinfo(strformat::bstr("  %1%: %2%\n") % Y("Warning") % strip_copy(warning, true));
+
+    if (batch_result_t::bs_failed == result.m_status)
+      mxinfo(strformat::bstr("  %1%\n") % strip_copy(result.m_error, true));
+
+    num_modified += batch_result_t::bs_modified == result.m_status ? 1 : 0;
+    num_failed   += batch_result_t::bs_failed   == result.m_status ? 1 : 0;
+  }
+
+  mxinfo(strformat::bstr(Y("%1% files processed: %2% modified, %3% without changes, %4% failed.\n"))
+         % results.size() % num_modified % (results.size() - num_modified - num_failed) % num_failed);
+
+  if (num_failed)
+    mxexit(2);
+}
+
+/** \brief Applies the same changes to several files concurrently
+
+   The changes have been parsed and validated once. Each worker thread
+   takes the next unprocessed file, edits a private copy of the
+   options for it and records the outcome. As each worker only has one
+   file open at a time, the number of jobs also limits the number of
+   files open at the same time.
+*/
+static void
+run_batch(options_cptr &options) {
+  auto num_files = options->m_file_names.size();
+  auto num_jobs  = options->m_num_jobs ? options->m_num_jobs : std::max(std::thread::hardware_concurrency(), 1u);
+  num_jobs       = std::min<std::size_t>(num_jobs, num_files);
+  auto verbosity = verbose;
+
+  std::vector<batch_result_t> results(num_files);
+  std::atomic<std::size_t> next_file{0};
+
+  auto worker = [&options, &results, &next_file, num_files, verbosity]() {
+    for (auto idx = next_file++; idx < num_files; idx = next_file++) {
+      auto &result = results[idx];
+
+      try {
+        run_in_job_context(verbosity, result.m_messages, result.m_warnings, [&options, &result, idx]() {
+          auto file_options             = options->clone_for(options->m_file_names[idx]);
+          file_options->m_show_progress = false;
+
+          result.m_status = run(file_options) ? batch_result_t::bs_modified : batch_result_t::bs_unchanged;
+        });
+
+      } catch (std::exception &ex) {
+        result.m_status = batch_result_t::bs_failed;
+        result.m_error  = ex.what();
+      }
+    }
+  };
+
+  mxinfo(strformat::bstr(Y("Editing %1% files with %2% jobs.\n")) % num_files % num_jobs);
 
-//  mxexit();
+  std::vector<std::thread> threads;
+  for (auto idx = 1u; idx < num_jobs; ++idx)
+    threads.emplace_back(worker);
+
+  worker();
+
+  for (auto &thread : threads)
+    thread.join();
+
+  display_batch_results(options, results);
+}
+
+static std::string s_trace_file_name;
+static bool s_trace_pending{};
+
+/** \brief Writes the trace recorded by \c run_edit() if there is one
+
+   Failed edits terminate the process without returning from
+   \c run_edit(). Therefore this is also run right before exiting.
+*/
+static void
+write_trace() {
+  if (!s_trace_pending)
+    return;
+
+  s_trace_pending = false;
+
+  try {
+    mm_file_io_c out{s_trace_file_name.empty() ? std::string{"mkvpropedit-trace.json"} : s_trace_file_name, MODE_CREATE};
+    mtx::tracing::write_chrome_json(out);
+
+  } catch (mtx::mm_io::exception &ex) {
+    mxwarn(strformat::bstr("The trace could not be written: %1%\n") % ex);
+  }
+}
+
+static void
+init_once(char const *argv0) {
+  // The common library, the translations and the property tables are
+  // shared by all edits in this process and must only be set up once.
+  static std::once_flag s_initialized;
+
+  std::call_once(s_initialized, [argv0]() {
+    mtx_common_init("mkvpropedit", argv0);
+    mxrun_before_exit([]() { display_io_accounting(); });
+    mxrun_before_exit([]() { write_trace(); });
+    mtx::cli::g_version_info = get_version_info("mkvpropedit", vif_full);
+  });
 }
 
 static
 void setup(char **argv) {
-  mtx_common_init("mkvpropedit", argv[0]);
+  init_once(argv[0]);
   clear_list_of_unique_numbers(UNIQUE_ALL_IDS);
-  mtx::cli::g_version_info = get_version_info("mkvpropedit", vif_full);
 }
 
 /** \brief Setup and high level program control
@@ -190,5 +464,162 @@ run_edit(int argc,
     options->dump_info();
   }
 
-  run(options);
+  // "--debug trace=<file>" records the time spent in each stage of
+  // the analysis and the update and writes it in the Chrome trace
+  // event format.
+  s_trace_pending = debugging_c::requested("trace", &s_trace_file_name);
+  mtx::tracing::enable(s_trace_pending);
+
+  if (1 < options->m_file_names.size())
+    run_batch(options);
+  else
+    run(options);
+
+  write_trace();
 }
+
+namespace mtx { namespace propedit {
+
+void
+set_file_opener(file_opener_t const &opener) {
+  s_file_opener = opener;
+}
+
+edit_job_c::edit_job_c(std::string const &file_name)
+  : m_file_name{file_name}
+{
+}
+
+edit_job_c &
+edit_job_c::edit(std::string const &selector) {
+  m_actions.emplace_back(action_e::edit, selector);
+  return *this;
+}
+
+edit_job_c &
+edit_job_c::add(std::string const &spec) {
+  m_actions.emplace_back(action_e::add, spec);
+  return *this;
+}
+
+edit_job_c &
+edit_job_c::set(std::string const &spec) {
+  m_actions.emplace_back(action_e::set, spec);
+  return *this;
+}
+
+edit_job_c &
+edit_job_c::remove(std::string const &spec) {
+  m_actions.emplace_back(action_e::remove, spec);
+  return *this;
+}
+
+edit_job_c &
+edit_job_c::set_parse_mode_full(bool parse_mode_full) {
+  m_parse_mode_full = parse_mode_full;
+  return *this;
+}
+
+edit_job_c &
+edit_job_c::set_layout_cache(bool use_layout_cache) {
+  m_use_layout_cache = use_layout_cache;
+  return *this;
+}
+
+edit_job_c &
+edit_job_c::set_analysis_threads(unsigned int num_threads) {
+  m_num_analysis_threads = std::max(num_threads, 1u);
+  return *this;
+}
+
+edit_job_c &
+edit_job_c::set_padding(std::string const &padding) {
+  m_padding = padding;
+  return *this;
+}
+
+edit_job_c &
+edit_job_c::set_verbosity(unsigned int verbosity) {
+  m_verbosity = verbosity;
+  return *this;
+}
+
+std::vector<std::string> const &
+edit_job_c::get_messages()
+  const {
+  return m_messages;
+}
+
+std::vector<std::string> const &
+edit_job_c::get_warnings()
+  const {
+  return m_warnings;
+}
+
+void
+edit_job_c::run() {
+  init_once("mkvpropedit");
+
+  m_messages.clear();
+  m_warnings.clear();
+
+  run_in_job_context(m_verbosity, m_messages, m_warnings, [this]() {
+    run_internal();
+  });
+}
+
+void
+edit_job_c::run_internal() {
+  auto options = std::make_shared<options_c>();
+  auto target  = options->add_track_or_segmentinfo_target("segment_info");
+
+  options->set_file_name(m_file_name);
+  options->m_use_layout_cache     = m_use_layout_cache;
+  options->m_num_analysis_threads = m_num_analysis_threads;
+
+  if (m_parse_mode_full)
+    options->set_parse_mode("full");
+
+  if (!m_padding.empty()) {
+    try {
+      options->set_padding_policy(m_padding);
+    } catch (...) {
+      throw edit_error_x{(strformat::bstr(Y("Invalid padding specification '%1%'.\n")) % m_padding).str()};
+    }
+  }
+
+  for (auto const &action : m_actions) {
+    if (action_e::edit == action.first) {
+      try {
+        target = options->add_track_or_segmentinfo_target(action.second);
+      } catch (edit_error_x &) {
+        throw;
+      } catch (...) {
+        throw edit_error_x{(strformat::bstr(Y("Invalid selector '%1%'.\n")) % action.second).str()};
+      }
+      continue;
+    }
+
+    auto type = action_e::add == action.first ? change_c::ct_add
+              : action_e::set == action.first ? change_c::ct_set
+              :                                 change_c::ct_delete;
+
+    try {
+      target->add_change(type, action.second);
+    } catch (edit_error_x &) {
+      throw;
+    } catch (std::runtime_error &error) {
+      throw edit_error_x{(strformat::bstr(Y("Invalid change spec (%2%) in '%1%'.\n")) % action.second % error.what()).str()};
+    }
+  }
+
+  options->options_parsed();
+  options->validate();
+
+  // Progress lines only make sense on a console.
+  options->m_show_progress = false;
+
+  ::run(options);
+}
+
+}}
@@ -9,10 +9,102 @@
 */
 
 #pragma once
-// 
+// 
+
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+class mm_io_c;
 
 void
 run_edit(int argc,
                char **argv);
 
+namespace mtx { namespace propedit {
+
+using file_opener_t = std::function<std::shared_ptr<mm_io_c>(std::string const &file_name)>;
+
+/** \brief Sets how the files edited by \c run_edit() and \c edit_job_c are opened
+
+   This allows accessing the files through a different I/O layer,
+   e.g. a block cache for files on remote storage. The returned file
+   must be opened for reading and writing. If no opener is set or if
+   it returns \c nullptr then the file is opened by its name.
+
+   The opener must be set before any edit is started. It is called
+   from the threads doing the edits.
+*/
+void set_file_opener(file_opener_t const &opener);
+
+/** \brief Thrown by \c edit_job_c::run() instead of terminating the process
+
+   The message is the one mkvpropedit would have printed before
+   exiting, e.g. for an invalid selector or a file that cannot be
+   opened for writing.
+*/
+class edit_error_x: public std::runtime_error {
+public:
+  explicit edit_error_x(std::string const &message)
+    : std::runtime_error{message}
+  {
+  }
+};
+
+/** \brief One in-process edit of a single file
+
+   This is the equivalent of a single mkvpropedit invocation without
+   going through \c argv. The selectors and property specifications
+   use the same syntax as the \c --edit, \c --add, \c --set and
+   \c --delete command line options.
+
+   Nothing is parsed or validated before \c run() is called. All
+   messages generated while the job runs are collected in the job
+   object instead of being printed, and errors are reported by
+   throwing \c edit_error_x. Separate jobs can run concurrently on
+   different threads as long as they edit different files.
+*/
+class edit_job_c {
+public:
+  enum class action_e {
+    edit,
+    add,
+    set,
+    remove,
+  };
+
+protected:
+  std::string m_file_name;
+  std::vector<std::pair<action_e, std::string>> m_actions;
+  std::vector<std::string> m_messages, m_warnings;
+  std::string m_padding;
+  unsigned int m_verbosity{1}, m_num_analysis_threads{1};
+  bool m_parse_mode_full{}, m_use_layout_cache{};
+
+public:
+  explicit edit_job_c(std::string const &file_name);
+
+  edit_job_c &edit(std::string const &selector);
+  edit_job_c &add(std::string const &spec);
+  edit_job_c &set(std::string const &spec);
+  edit_job_c &remove(std::string const &spec);
+
+  edit_job_c &set_parse_mode_full(bool parse_mode_full);
+  edit_job_c &set_layout_cache(bool use_layout_cache);
+  edit_job_c &set_analysis_threads(unsigned int num_threads);
+  edit_job_c &set_padding(std::string const &padding);
+  edit_job_c &set_verbosity(unsigned int verbosity);
+
+  void run();
+
+  std::vector<std::string> const &get_messages() const;
+  std::vector<std::string> const &get_warnings() const;
+
+protected:
+  void run_internal();
+};
 
+}}
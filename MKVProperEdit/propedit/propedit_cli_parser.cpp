@@ -37,6 +37,32 @@ propedit_cli_parser_c::set_parse_mode() {
   }
 }
 
+void
+propedit_cli_parser_c::enable_layout_cache() {
+  m_options->m_use_layout_cache = true;
+}
+
+void
+propedit_cli_parser_c::set_analysis_threads() {
+  if (!parse_number(m_next_arg, m_options->m_num_analysis_threads) || !m_options->m_num_analysis_threads)
+    mxerror(strformat::bstr(Y("Invalid number of threads in '%1% %2%'.\n")) % m_current_arg % m_next_arg);
+}
+
+void
+propedit_cli_parser_c::set_num_jobs() {
+  if (!parse_number(m_next_arg, m_options->m_num_jobs) || !m_options->m_num_jobs)
+    mxerror(strformat::bstr(Y("Invalid number of jobs in '%1% %2%'.\n")) % m_current_arg % m_next_arg);
+}
+
+void
+propedit_cli_parser_c::set_padding_policy() {
+  try {
+    m_options->set_padding_policy(m_next_arg);
+  } catch (...) {
+    mxerror(strformat::bstr(Y("Invalid padding specification in '%1% %2%'.\n")) % m_current_arg % m_next_arg);
+  }
+}
+
 void
 propedit_cli_parser_c::add_target() {
   try {
@@ -170,10 +196,20 @@ propedit_cli_parser_c::set_file_name() {
 void
 propedit_cli_parser_c::init_parser() {
   add_information(YT("mkvpropedit [options] <file> <actions>"));
+  add_information(YT("mkvpropedit [options] <file1> <file2> ... <actions>"));
 
   add_section_header(YT("Options"));
   OPT("l|list-property-names",      list_property_names, YT("List all valid property names and exit"));
   OPT("p|parse-mode=<mode>",        set_parse_mode,      YT("Sets the Matroska parser mode to 'fast' (default) or 'full'"));
+  OPT("layout-cache",               enable_layout_cache, YT("Keep the positions of the file's level 1 elements in a file next to it "
+                                                            "('<file>.layout-cache') so that later runs can skip analyzing the file"));
+  OPT("analysis-threads=<n>",       set_analysis_threads, YT("Use up to 'n' threads for indexing the clusters of large files in the "
+                                                             "'full' parse mode (default: 1)"));
+  OPT("jobs=<n>",                   set_num_jobs,        YT("Edit up to 'n' files at the same time if more than one file name is given "
+                                                            "(default: the number of processor cores)"));
+  OPT("padding=<size[,percent%]>",  set_padding_policy,  YT("Leave this many bytes or this percentage of an element's size, whichever is larger, "
+                                                            "free behind elements written before the first cluster so that later edits "
+                                                            "can overwrite them in place"));
 
   add_section_header(YT("Actions for handling properties"));
   OPT("e|edit=<selector>",          add_target,          YT("Sets the Matroska file section that all following add/set/delete "
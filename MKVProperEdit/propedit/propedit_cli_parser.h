@@ -35,6 +35,10 @@ protected:
   void add_tags();
   void add_chapters();
   void set_parse_mode();
+  void enable_layout_cache();
+  void set_analysis_threads();
+  void set_num_jobs();
+  void set_padding_policy();
   void set_file_name();
 
   void set_attachment_name();
@@ -33,6 +33,17 @@ segment_info_target_c::operator ==(target_c const &cmp)
   return dynamic_cast<segment_info_target_c const *>(&cmp);
 }
 
+target_cptr
+segment_info_target_c::clone()
+  const {
+  auto copy = std::make_shared<segment_info_target_c>(*this);
+
+  for (auto &change : copy->m_changes)
+    change = std::make_shared<change_c>(*change);
+
+  return copy;
+}
+
 void
 segment_info_target_c::validate() {
   look_up_property_elements();
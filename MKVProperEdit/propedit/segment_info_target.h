@@ -26,6 +26,7 @@ public:
   segment_info_target_c();
   virtual ~segment_info_target_c() override;
 
+  virtual target_cptr clone() const override;
   virtual void validate() override;
   virtual void look_up_property_elements();
 
@@ -22,6 +22,8 @@
 using namespace libebml;
 
 class kax_analyzer_c;
+class target_c;
+using target_cptr = std::shared_ptr<target_c>;
 
 class target_c {
 protected:
@@ -40,6 +42,7 @@ public:
   target_c();
   virtual ~target_c();
 
+  virtual target_cptr clone() const = 0;
   virtual void validate() = 0;
 
   virtual void dump_info() const = 0;
@@ -68,4 +71,3 @@ public:
 protected:
   virtual void add_or_replace_all_master_elements(EbmlMaster *source);
 };
-using target_cptr = std::shared_ptr<target_c>;
@@ -40,6 +40,17 @@ track_target_c::operator ==(target_c const &cmp)
       && (m_selection_track_type == other_track->m_selection_track_type);
 }
 
+target_cptr
+track_target_c::clone()
+  const {
+  auto copy = std::make_shared<track_target_c>(*this);
+
+  for (auto &change : copy->m_changes)
+    change = std::make_shared<change_c>(*change);
+
+  return copy;
+}
+
 void
 track_target_c::validate() {
   if (INVALID_TRACK_TYPE == m_track_type)
@@ -38,6 +38,7 @@ public:
   track_target_c(std::string const &spec);
   virtual ~track_target_c() override;
 
+  virtual target_cptr clone() const override;
   virtual void validate() override;
   virtual void look_up_property_elements();
 
@@ -55,6 +55,13 @@ START_LIBEBML_NAMESPACE
     \class EbmlBinary
     \brief Handle all operations on an EBML element that contains "unknown" binary data
 
+    When read with SCOPE_LAZY_DATA large payloads only record where
+    they are located in the input. They are loaded on first access and
+    copied straight from the input when rendered. The input must stay
+    open and the payload unchanged until then, or Load() must be
+    called beforehand. Copies read the payload into memory right away
+    as they aren't known to whoever keeps track of the original.
+
   \todo handle fix sized elements (like UID of CodecID)
 */
 class EBML_DLL_API EbmlBinary : public EbmlElement {
@@ -71,15 +78,32 @@ class EBML_DLL_API EbmlBinary : public EbmlElement {
 
     void SetBuffer(const binary *Buffer, const uint32 BufferSize) {
       Data = (binary *) Buffer;
+      Source = NULL;
       SetSize_(BufferSize);
       SetValueIsSet();
     }
 
-    binary *GetBuffer() const {return Data;}
+    binary *GetBuffer() const {Load(); return Data;}
+
+    /*!
+      \brief read a lazily read payload into memory if it hasn't been yet
+    */
+    void Load() const {
+      if (Source != NULL)
+        LoadFromSource();
+    }
+
+    bool IsLazy() const {return Source != NULL;}
+
+    /*!
+      \brief where a lazily read payload is located in its input, only valid if IsLazy()
+    */
+    uint64 GetSourcePosition() const {return SourcePosition;}
 
     void CopyBuffer(const binary *Buffer, const uint32 BufferSize) {
       if (Data != NULL)
         free(Data);
+      Source = NULL;
       Data = (binary *)malloc(BufferSize * sizeof(binary));
       memcpy(Data, Buffer, BufferSize);
       SetSize_(BufferSize);
@@ -99,7 +123,14 @@ class EBML_DLL_API EbmlBinary : public EbmlElement {
 #else
   protected:
 #endif
-    binary *Data; // the binary data inside the element
+    mutable binary *Data; // the binary data inside the element
+
+  private:
+    void LoadFromSource() const;
+    void CopyFromSource(IOCallback & output);
+
+    mutable IOCallback *Source; // where a lazily read payload is located
+    uint64 SourcePosition;
 };
 
 END_LIBEBML_NAMESPACE
@@ -34,6 +34,9 @@
 #ifndef LIBEBML_ELEMENT_H
 #define LIBEBML_ELEMENT_H
 
+#include <atomic>
+#include <new>
+
 #include "EbmlTypes.h"
 #include "EbmlId.h"
 #include "IOCallback.h"
@@ -326,6 +329,8 @@ class EBML_DLL_API EbmlSemantic {
 
 typedef const class EbmlSemanticContext & (*_GetSemanticContext)();
 
+class EbmlSemanticLookup;
+
 /*!
   Context of the element
   \todo allow more than one parent ?
@@ -338,7 +343,11 @@ class EBML_DLL_API EbmlSemanticContext {
       const _GetSemanticContext aGetGlobalContext,
       const EbmlCallbacks *aMasterElt)
       : GetGlobalContext(aGetGlobalContext), MyTable(aMyTable), Size(aSize),
-        UpTable(aUpTable), MasterElt(aMasterElt) {}
+        UpTable(aUpTable), MasterElt(aMasterElt), Lookup(NULL) {}
+
+    EbmlSemanticContext(const EbmlSemanticContext & aElt)
+      : GetGlobalContext(aElt.GetGlobalContext), MyTable(aElt.MyTable), Size(aElt.Size),
+        UpTable(aElt.UpTable), MasterElt(aElt.MasterElt), Lookup(NULL) {}
 
     bool operator!=(const EbmlSemanticContext & aElt) const {
       return ((Size != aElt.Size) || (MyTable != aElt.MyTable) ||
@@ -350,6 +359,7 @@ class EBML_DLL_API EbmlSemanticContext {
         inline const EbmlCallbacks* GetMaster() const { return MasterElt; }
         inline const EbmlSemanticContext* Parent() const { return UpTable; }
         const EbmlSemantic & GetSemantic(size_t i) const;
+        const EbmlSemanticLookup & GetLookup() const;
 
     const _GetSemanticContext GetGlobalContext; ///< global elements supported at this level
 
@@ -361,6 +371,52 @@ class EBML_DLL_API EbmlSemanticContext {
     const EbmlSemanticContext *UpTable; ///< Parent element
     /// \todo replace with the global context directly
     const EbmlCallbacks *MasterElt;
+
+    /// resolution of IDs in this context and its parents, built on first use and never freed
+    mutable std::atomic<const EbmlSemanticLookup *> Lookup;
+};
+
+/*!
+  \class EbmlArena
+  \brief Memory for elements that are created together, e.g. by EbmlMaster::Read()
+
+  While an EbmlArena::Scope is alive, the elements created on its thread are
+  taken from large blocks of the arena instead of one heap allocation each.
+  Such elements are owned and deleted like any other element: they can be
+  removed from their master, pushed into another one and outlive the arena.
+  A block is freed once the arena has moved on and all its elements are gone.
+*/
+class EBML_DLL_API EbmlArena {
+  public:
+    EbmlArena(size_t aBlockSize = 64 * 1024);
+    ~EbmlArena();
+
+    class EBML_DLL_API Scope {
+      public:
+        Scope(EbmlArena & aArena);
+        ~Scope();
+
+      private:
+        Scope(const Scope &);
+        Scope & operator=(const Scope &);
+
+        EbmlArena *Previous;
+    };
+
+    /// memory for an element, from the current thread's arena if there is one
+    static void *AllocateElement(size_t Size, bool bThrow);
+    static void FreeElement(void *Memory);
+
+  private:
+    EbmlArena(const EbmlArena &);
+    EbmlArena & operator=(const EbmlArena &);
+
+    class Block;
+
+    void *Allocate(size_t Size, Block *& Owner);
+
+    size_t BlockSize;
+    Block *CurrentBlock;
 };
 
 /*!
@@ -372,8 +428,18 @@ class EBML_DLL_API EbmlElement {
     EbmlElement(uint64 aDefaultSize, bool bValueSet = false);
     virtual ~EbmlElement();
 
+    static void *operator new(size_t Size) {return EbmlArena::AllocateElement(Size, true);}
+    static void *operator new(size_t Size, const std::nothrow_t &) throw() {return EbmlArena::AllocateElement(Size, false);}
+    static void operator delete(void *Memory) {EbmlArena::FreeElement(Memory);}
+    static void operator delete(void *Memory, const std::nothrow_t &) throw() {EbmlArena::FreeElement(Memory);}
+
     /// Set the minimum length that will be used to write the element size (-1 = optimal)
-    void SetSizeLength(int NewSizeLength) {SizeLength = NewSizeLength;}
+    void SetSizeLength(int NewSizeLength) {
+      if (SizeLength != NewSizeLength) {
+        SizeLength = NewSizeLength;
+        SizeMayHaveChanged();
+      }
+    }
     int GetSizeLength() const {return SizeLength;}
 
     static EbmlElement * FindNextElement(IOCallback & DataStream, const EbmlSemanticContext & Context, int & UpperLevel, uint64 MaxDataSize, bool AllowDummyElt, unsigned int MaxLowerLevel = 1);
@@ -418,6 +484,12 @@ class EBML_DLL_API EbmlElement {
     virtual filepos_t UpdateSize(bool bWithDefault = false, bool bForceRender = false) = 0; /// update the Size of the Data stored
     virtual filepos_t GetSize() const {return Size;} /// return the size of the data stored in the element, on reading
 
+    /*!
+      \brief tell if UpdateSize() only depends on changes that are counted by the size generation
+      \note Elements computing their size from other objects must return false.
+    */
+    virtual bool IsSizeCacheable() const {return true;}
+
     virtual filepos_t ReadData(IOCallback & input, ScopeMode ReadFully = SCOPE_ALL_DATA) = 0;
     virtual void Read(EbmlStream & inDataStream, const EbmlSemanticContext & Context, int & UpperEltFound, EbmlElement * & FoundElt, bool AllowDummyElt = false, ScopeMode ReadFully = SCOPE_ALL_DATA);
 
@@ -457,7 +529,7 @@ class EBML_DLL_API EbmlElement {
     /*!
       \brief set the default size of an element
     */
-    virtual void SetDefaultSize(uint64 aDefaultSize) {DefaultSize = aDefaultSize;}
+    virtual void SetDefaultSize(uint64 aDefaultSize) {DefaultSize = aDefaultSize; SizeMayHaveChanged();}
 
     bool ValueIsSet() const {return bValueIsSet;}
 
@@ -487,12 +559,32 @@ class EBML_DLL_API EbmlElement {
     EbmlElement(const EbmlElement & ElementToClone);
 
         inline uint64 GetDefaultSize() const {return DefaultSize;}
-        inline void SetSize_(uint64 aSize) {Size = aSize;}
-        inline void SetValueIsSet(bool Set = true) {bValueIsSet = Set;}
-        inline void SetDefaultIsSet(bool Set = true) {DefaultIsSet = Set;}
-        inline void SetSizeIsFinite(bool Set = true) {bSizeIsFinite = Set;}
+        inline void SetSize_(uint64 aSize) {
+          if (Size != aSize) {
+            Size = aSize;
+            SizeMayHaveChanged();
+          }
+        }
+        inline void SetValueIsSet(bool Set = true) {bValueIsSet = Set; SizeMayHaveChanged();}
+        inline void SetDefaultIsSet(bool Set = true) {DefaultIsSet = Set; SizeMayHaveChanged();}
+        inline void SetSizeIsFinite(bool Set = true) {
+          if (bSizeIsFinite != Set) {
+            bSizeIsFinite = Set;
+            SizeMayHaveChanged();
+          }
+        }
         inline uint64 GetSizePosition() const {return SizePosition;}
 
+    /*!
+      \brief count a change of a value, size or list of children of any element
+      \note Masters keep their computed size as long as the count doesn't change.
+        Each thread has its own count, and no two threads ever reach the same
+        one. A tree has to be changed in the thread that renders it or has
+        to be rendered after it was handed over to another thread.
+    */
+    static void SizeMayHaveChanged();
+    static uint64 GetSizeGeneration();
+
 #if defined(EBML_STRICT_API)
   private:
 #endif
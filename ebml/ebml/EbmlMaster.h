@@ -122,6 +122,9 @@ class EBML_DLL_API EbmlMaster : public EbmlElement {
 
     size_t ListSize() const {return ElementList.size();}
     std::vector<EbmlElement *> const &GetElementList() const {return ElementList;}
+    // Changing the list through the non-const accessors isn't counted
+    // as a change of the size; use PushElement(), InsertElement() and
+    // Remove() for that.
     std::vector<EbmlElement *> &GetElementList() {return ElementList;}
 
         inline EBML_MASTER_ITERATOR begin() {return ElementList.begin();}
@@ -140,6 +143,7 @@ class EBML_DLL_API EbmlMaster : public EbmlElement {
       return (ElementList.size() == 0);
     }
     virtual bool IsMaster() const {return true;}
+    virtual bool IsSizeCacheable() const {return bSizeCacheable;}
 
     /*!
       \brief verify that all mandatory elements are present
@@ -157,20 +161,21 @@ class EBML_DLL_API EbmlMaster : public EbmlElement {
     /*!
       \brief remove all elements, even the mandatory ones
     */
-    void RemoveAll() {ElementList.clear();}
+    void RemoveAll() {ElementList.clear(); SizeMayHaveChanged();}
 
     /*!
       \brief facility for Master elements to write only the head and force the size later
     */
     filepos_t WriteHead(IOCallback & output, int SizeLength, bool bWithDefault = false);
 
-    void EnableChecksum(bool bIsEnabled = true) { bChecksumUsed = bIsEnabled; }
+    void EnableChecksum(bool bIsEnabled = true) { bChecksumUsed = bIsEnabled; SizeMayHaveChanged(); }
     bool HasChecksum() const {return bChecksumUsed;}
     bool VerifyChecksum() const;
     uint32 GetCrc32() const {return Checksum.GetCrc32();}
     void ForceChecksum(uint32 NewChecksum) {
       Checksum.ForceCrc32(NewChecksum);
       bChecksumUsed = true;
+      SizeMayHaveChanged();
     }
 
     /*!
@@ -195,6 +200,18 @@ class EBML_DLL_API EbmlMaster : public EbmlElement {
       \brief Add all the mandatory elements to the list
     */
     bool ProcessMandatory();
+
+    /*!
+      \brief the size generation and parameters the size was last computed with
+      \note The children's sizes are only computed again after a change of
+        any element in the same thread, so that rendering computes the sizes
+        of a tree once.
+    */
+    bool      bSizeCached;
+    bool      bSizeCacheable;
+    bool      bCachedWithDefault;
+    bool      bCachedForceRender;
+    uint64    CachedSizeGeneration;
 };
 
 ///< \todo add a restriction to only elements legal in the context
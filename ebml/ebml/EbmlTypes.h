@@ -64,7 +64,8 @@ typedef Endian<bits80,big_endian>    big_80bits;
 enum ScopeMode {
   SCOPE_PARTIAL_DATA = 0,
   SCOPE_ALL_DATA,
-  SCOPE_NO_DATA
+  SCOPE_NO_DATA,
+  SCOPE_LAZY_DATA // like SCOPE_ALL_DATA but large binary payloads are only read when accessed
 };
 
 END_LIBEBML_NAMESPACE
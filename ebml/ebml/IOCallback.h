@@ -81,6 +81,17 @@ public:
   // should be thrown.
   virtual void close()=0;
 
+  // The peek callback copies up to Size bytes at the file pointer to the
+  // buffer without moving the file pointer. It may return fewer bytes than
+  // requested even before the end of the file; 0 is only returned at its end.
+  // The default implementation reads and seeks back. Callbacks keeping the
+  // data in memory should override it.
+  virtual uint32 peek(void*Buffer,size_t Size);
+
+  // The consume callback moves the file pointer forward by Size bytes, e.g.
+  // behind data that has been peeked at.
+  virtual void consume(size_t Size);
+
 
   // The readFully is made virtual to allow derived classes to use another
   // implementation for this method, which e.g. does not read any data
@@ -56,6 +56,11 @@ public:
   */
   uint32 read(void *Buffer, size_t Size);
 
+  /*!
+    Use this to copy some data to the Buffer without moving the file pointer
+  */
+  uint32 peek(void *Buffer, size_t Size);
+
   /*!
     Seek to the specified position. The mode can have either SEEK_SET, SEEK_CUR
     or SEEK_END. The callback should return true(1) if the seek operation succeeded
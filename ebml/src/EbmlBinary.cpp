@@ -34,24 +34,31 @@
   \author Steve Lhomme     <robux4 @ users.sf.net>
   \author Julien Coloos  <suiryc @ users.sf.net>
 */
+#include <algorithm>
 #include <cassert>
 #include <string>
+#include <vector>
 
 #include "ebml/EbmlBinary.h"
 #include "ebml/StdIOCallback.h"
 
 START_LIBEBML_NAMESPACE
 
+// Payloads smaller than this are always read right away.
+static const uint64 LazyMinimumSize = 64 * 1024;
+static const size_t LazyCopyChunkSize = 64 * 1024;
+
 EbmlBinary::EbmlBinary()
-  :EbmlElement(0, false), Data(NULL)
+  :EbmlElement(0, false), Data(NULL), Source(NULL), SourcePosition(0)
 {}
 
 EbmlBinary::EbmlBinary(const EbmlBinary & ElementToClone)
-  :EbmlElement(ElementToClone)
+  :EbmlElement(ElementToClone), Data(NULL), Source(ElementToClone.Source), SourcePosition(ElementToClone.SourcePosition)
 {
-  if (ElementToClone.Data == NULL)
-    Data = NULL;
-  else {
+  if (Source != NULL)
+    // the copy reads its own payload, the original stays lazy
+    LoadFromSource();
+  else if (ElementToClone.Data != NULL) {
     Data = (binary *)malloc(GetSize() * sizeof(binary));
     assert(Data != NULL);
     memcpy(Data, ElementToClone.Data, GetSize());
@@ -63,16 +70,73 @@ EbmlBinary::~EbmlBinary(void) {
     free(Data);
 }
 
-EbmlBinary::operator const binary &() const {return *Data;}
+EbmlBinary::operator const binary &() const {return *GetBuffer();}
 
 
 filepos_t EbmlBinary::RenderData(IOCallback & output, bool /* bForceRender */, bool /* bWithDefault */)
 {
-  output.writeFully(Data,GetSize());
+  if (Source != NULL)
+    CopyFromSource(output);
+  else
+    output.writeFully(Data,GetSize());
 
   return GetSize();
 }
 
+void EbmlBinary::LoadFromSource() const
+{
+  binary *Buffer = (binary *)malloc(GetSize());
+  if (Buffer == NULL)
+    throw CRTError(std::string("Error allocating data"));
+
+  uint64 CurrentPosition = Source->getFilePointer();
+  Source->setFilePointer(SourcePosition);
+  uint32 SizeRead = Source->read(Buffer, GetSize());
+  Source->setFilePointer(CurrentPosition);
+
+  if (SizeRead != GetSize()) {
+    free(Buffer);
+    throw CRTError(std::string("Error reading lazily read data"));
+  }
+
+  Data = Buffer;
+  Source = NULL;
+}
+
+/*!
+  \brief copy a lazily read payload to the current position of output in chunks
+  \note output may be the payload's source as long as the element is
+    not rendered over the payload itself. The payload then refers to
+    its new copy afterwards so that the old one may be overwritten.
+*/
+void EbmlBinary::CopyFromSource(IOCallback & output)
+{
+  std::vector<binary> Buffer(LazyCopyChunkSize);
+  bool SameFile = Source == &output;
+  uint64 Destination = output.getFilePointer();
+  uint64 SourceCurrentPosition = Source->getFilePointer();
+  uint64 Done = 0;
+
+  while (Done < GetSize()) {
+    size_t Chunk = static_cast<size_t>(std::min<uint64>(GetSize() - Done, LazyCopyChunkSize));
+
+    Source->setFilePointer(SourcePosition + Done);
+    if (Source->read(&Buffer[0], Chunk) != Chunk)
+      throw CRTError(std::string("Error reading lazily read data"));
+
+    if (SameFile)
+      output.setFilePointer(Destination + Done);
+    output.writeFully(&Buffer[0], Chunk);
+
+    Done += Chunk;
+  }
+
+  if (SameFile)
+    SourcePosition = Destination;
+  else
+    Source->setFilePointer(SourceCurrentPosition);
+}
+
 /*!
   \note no Default binary value handled
 */
@@ -85,6 +149,7 @@ filepos_t EbmlBinary::ReadData(IOCallback & input, ScopeMode ReadFully)
 {
   if (Data != NULL)
     free(Data);
+  Source = NULL;
 
   if (ReadFully == SCOPE_NO_DATA) {
     Data = NULL;
@@ -97,6 +162,15 @@ filepos_t EbmlBinary::ReadData(IOCallback & input, ScopeMode ReadFully)
     return 0;
   }
 
+  if ((ReadFully == SCOPE_LAZY_DATA) && (GetSize() >= LazyMinimumSize)) {
+    Data = NULL;
+    Source = &input;
+    SourcePosition = input.getFilePointer();
+    input.setFilePointer(GetSize(), seek_current);
+    SetValueIsSet();
+    return GetSize();
+  }
+
   Data = (binary *)malloc(GetSize());
   if (Data == NULL)
     throw CRTError(std::string("Error allocating data"));
@@ -106,7 +180,7 @@ filepos_t EbmlBinary::ReadData(IOCallback & input, ScopeMode ReadFully)
 
 bool EbmlBinary::operator==(const EbmlBinary & ElementToCompare) const
 {
-  return ((GetSize() == ElementToCompare.GetSize()) && (GetSize() == 0 || !memcmp(Data, ElementToCompare.Data, GetSize())));
+  return ((GetSize() == ElementToCompare.GetSize()) && (GetSize() == 0 || !memcmp(GetBuffer(), ElementToCompare.GetBuffer(), GetSize())));
 }
 
 END_LIBEBML_NAMESPACE
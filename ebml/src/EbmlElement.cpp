@@ -38,6 +38,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
+#include <vector>
 
 #include "ebml/EbmlElement.h"
 #include "ebml/EbmlMaster.h"
@@ -231,6 +232,296 @@ const EbmlSemantic & EbmlSemanticContext::GetSemantic(size_t i) const
   throw std::logic_error(ss.str());
 }
 
+/*!
+  \brief Resolution of IDs as done by EbmlElement::CreateElementUsingContext()
+
+  The table holds every ID known in a context, in its global context and in
+  its parents, together with the change of the level the element is found
+  at. IDs known at several places are resolved in the order used by
+  CreateElementUsingContext(): the context itself, its global context, its
+  master and finally its parents. The outcome for unknown IDs is stored as
+  well. Once built the table is never changed.
+*/
+class EbmlSemanticLookup {
+public:
+  struct Entry {
+    uint64 Key; ///< 0 for an empty slot
+    const EbmlCallbacks *Callbacks;
+    int LevelDelta;
+  };
+
+  EbmlSemanticLookup(const EbmlSemanticContext & Context);
+
+  const Entry *Find(const EbmlId & aID) const {
+    uint64 aKey = MakeKey(aID);
+    for (size_t Index = Hash(aKey); ; Index = (Index + 1) & Mask) {
+      if (Slots[Index].Key == aKey)
+        return &Slots[Index];
+      if (Slots[Index].Key == 0)
+        return NULL;
+    }
+  }
+
+  int MissLevelDelta; ///< level change for unknown IDs
+  bool MissAllowsDummy; ///< whether unknown IDs may be turned into dummy elements
+
+protected:
+  static uint64 MakeKey(const EbmlId & aID) {
+    return (uint64(EBML_ID_LENGTH(aID)) << 32) | EBML_ID_VALUE(aID);
+  }
+
+  size_t Hash(uint64 aKey) const {
+    return size_t((aKey * 0x9E3779B97F4A7C15ULL) >> 32) & Mask;
+  }
+
+  void Add(uint64 aKey, const EbmlCallbacks *Callbacks, int LevelDelta);
+  void AddFound(const EbmlSemanticLookup & Other, int LevelDelta);
+
+  std::vector<Entry> Slots;
+  size_t Mask;
+};
+
+EbmlSemanticLookup::EbmlSemanticLookup(const EbmlSemanticContext & Context)
+  :MissLevelDelta(0), MissAllowsDummy(false), Mask(0)
+{
+  const EbmlSemanticContext & GlobalContext = Context.GetGlobalContext();
+  bool bIsGlobal = !(GlobalContext != Context);
+
+  // size the table for all candidates so that it is at most half full
+  size_t NumCandidates = EBML_CTX_SIZE(Context) + 1;
+  if (!bIsGlobal)
+    NumCandidates += GlobalContext.GetLookup().Slots.size() / 2;
+  if (EBML_CTX_PARENT(Context) != NULL)
+    NumCandidates += EBML_CTX_PARENT(Context)->GetLookup().Slots.size() / 2;
+
+  size_t NumSlots = 8;
+  while (NumSlots < 2 * NumCandidates)
+    NumSlots *= 2;
+  Slots.resize(NumSlots, Entry());
+  Mask = NumSlots - 1;
+
+  // elements at the current level
+  for (size_t Index = 0; Index < EBML_CTX_SIZE(Context); Index++) {
+    const EbmlCallbacks & Callbacks = EBML_CTX_IDX(Context,Index);
+    Add(MakeKey(EBML_INFO_ID(Callbacks)), &Callbacks, 0);
+  }
+
+  // a context that is its own global context knows nothing else
+  if (bIsGlobal)
+    return;
+
+  // global elements
+  const EbmlSemanticLookup & GlobalLookup = GlobalContext.GetLookup();
+  AddFound(GlobalLookup, -1);
+  MissLevelDelta = GlobalLookup.MissLevelDelta;
+
+  // parent elements
+  if (EBML_CTX_MASTER(Context) != NULL)
+    Add(MakeKey(EBML_INFO_ID(*EBML_CTX_MASTER(Context))), EBML_CTX_MASTER(Context), 1);
+
+  // elements of an upper context
+  if (EBML_CTX_PARENT(Context) != NULL) {
+    const EbmlSemanticLookup & ParentLookup = EBML_CTX_PARENT(Context)->GetLookup();
+    AddFound(ParentLookup, 1);
+    MissLevelDelta += ParentLookup.MissLevelDelta + 1;
+    MissAllowsDummy = ParentLookup.MissAllowsDummy;
+  } else
+    MissAllowsDummy = true;
+}
+
+void EbmlSemanticLookup::Add(uint64 aKey, const EbmlCallbacks *Callbacks, int LevelDelta)
+{
+  size_t Index = Hash(aKey);
+  while (Slots[Index].Key != 0) {
+    // IDs found earlier take precedence
+    if (Slots[Index].Key == aKey)
+      return;
+    Index = (Index + 1) & Mask;
+  }
+
+  Slots[Index].Key = aKey;
+  Slots[Index].Callbacks = Callbacks;
+  Slots[Index].LevelDelta = LevelDelta;
+}
+
+void EbmlSemanticLookup::AddFound(const EbmlSemanticLookup & Other, int LevelDelta)
+{
+  // Other's slots aren't in the order of precedence, but they contain
+  // each ID only once
+  for (size_t Index = 0; Index < Other.Slots.size(); Index++)
+    if (Other.Slots[Index].Key != 0)
+      Add(Other.Slots[Index].Key, Other.Slots[Index].Callbacks, Other.Slots[Index].LevelDelta + LevelDelta);
+}
+
+const EbmlSemanticLookup & EbmlSemanticContext::GetLookup() const
+{
+  const EbmlSemanticLookup *Result = Lookup.load(std::memory_order_acquire);
+  if (Result != NULL)
+    return *Result;
+
+  // several threads may build the table at the same time, only one wins
+  EbmlSemanticLookup *NewLookup = new EbmlSemanticLookup(*this);
+  if (Lookup.compare_exchange_strong(Result, NewLookup, std::memory_order_acq_rel))
+    return *NewLookup;
+
+  delete NewLookup;
+  return *Result;
+}
+
+namespace {
+
+// Each element is preceded by the block it was taken from, NULL for
+// elements taken from the heap. The size keeps the element aligned for
+// any type.
+const size_t ElementHeaderSize = 16;
+
+thread_local EbmlArena *CurrentArena = NULL;
+
+}
+
+class EbmlArena::Block {
+public:
+  static Block *New(size_t Size) {
+    void *Memory = ::operator new(DataOffset() + Size);
+    return new (Memory) Block();
+  }
+
+  binary *Data() {
+    return reinterpret_cast<binary *>(this) + DataOffset();
+  }
+
+  void AddReference() {
+    References.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void Release() {
+    if (References.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return;
+    this->~Block();
+    ::operator delete(this);
+  }
+
+  size_t Used;
+
+private:
+  // the arena holds one reference as long as it allocates from the block
+  Block() :Used(0), References(1) {}
+
+  static size_t DataOffset() {
+    return (sizeof(Block) + ElementHeaderSize - 1) / ElementHeaderSize * ElementHeaderSize;
+  }
+
+  std::atomic<size_t> References;
+};
+
+EbmlArena::EbmlArena(size_t aBlockSize)
+  :BlockSize(aBlockSize), CurrentBlock(NULL)
+{}
+
+EbmlArena::~EbmlArena()
+{
+  if (CurrentBlock != NULL)
+    CurrentBlock->Release();
+}
+
+void *EbmlArena::Allocate(size_t Size, Block *& Owner)
+{
+  Size = (Size + ElementHeaderSize - 1) / ElementHeaderSize * ElementHeaderSize;
+  // large elements would waste most of a block
+  if (Size > BlockSize / 4)
+    return NULL;
+
+  if (CurrentBlock == NULL || CurrentBlock->Used + Size > BlockSize) {
+    if (CurrentBlock != NULL)
+      CurrentBlock->Release();
+    CurrentBlock = NULL; // in case the new block cannot be allocated
+    CurrentBlock = Block::New(BlockSize);
+  }
+
+  void *Memory = CurrentBlock->Data() + CurrentBlock->Used;
+  CurrentBlock->Used += Size;
+  CurrentBlock->AddReference();
+  Owner = CurrentBlock;
+
+  return Memory;
+}
+
+void *EbmlArena::AllocateElement(size_t Size, bool bThrow)
+{
+  Block *Owner = NULL;
+  void *Memory = NULL;
+
+  if (CurrentArena != NULL) {
+    try {
+      Memory = CurrentArena->Allocate(ElementHeaderSize + Size, Owner);
+    } catch (std::bad_alloc &) {
+      if (bThrow)
+        throw;
+    }
+  }
+
+  if (Memory == NULL) {
+    Memory = bThrow ? ::operator new(ElementHeaderSize + Size) : ::operator new(ElementHeaderSize + Size, std::nothrow);
+    if (Memory == NULL)
+      return NULL;
+  }
+
+  *static_cast<Block **>(Memory) = Owner;
+  return static_cast<binary *>(Memory) + ElementHeaderSize;
+}
+
+void EbmlArena::FreeElement(void *Memory)
+{
+  if (Memory == NULL)
+    return;
+
+  void *Header = static_cast<binary *>(Memory) - ElementHeaderSize;
+  Block *Owner = *static_cast<Block **>(Header);
+  if (Owner != NULL)
+    Owner->Release();
+  else
+    ::operator delete(Header);
+}
+
+EbmlArena::Scope::Scope(EbmlArena & aArena)
+  :Previous(CurrentArena)
+{
+  CurrentArena = &aArena;
+}
+
+EbmlArena::Scope::~Scope()
+{
+  CurrentArena = Previous;
+}
+
+namespace {
+
+// Each thread counts from its own start so that a size computed in one
+// thread is never taken as current in another one. 2^40 changes per
+// thread are enough for any run.
+const unsigned int SizeGenerationThreadShift = 40;
+
+std::atomic<uint64> NextSizeGenerationThread(0);
+thread_local uint64 SizeGeneration = 0;
+
+uint64 & CurrentSizeGeneration()
+{
+  if (SizeGeneration == 0)
+    SizeGeneration = (NextSizeGenerationThread.fetch_add(1, std::memory_order_relaxed) + 1) << SizeGenerationThreadShift;
+  return SizeGeneration;
+}
+
+}
+
+void EbmlElement::SizeMayHaveChanged()
+{
+  ++CurrentSizeGeneration();
+}
+
+uint64 EbmlElement::GetSizeGeneration()
+{
+  return CurrentSizeGeneration();
+}
 
 EbmlElement::EbmlElement(uint64 aDefaultSize, bool bValueSet)
   :DefaultSize(aDefaultSize)
@@ -358,6 +649,42 @@ EbmlElement * EbmlElement::FindNextID(IOCallback & DataStream, const EbmlCallbac
 }
 
 
+/*!
+  \brief Reads single bytes through a window filled by IOCallback::peek()
+
+  This avoids one virtual read call per byte. The stream's file pointer
+  stays at the start of the window until Sync() is called.
+*/
+class EbmlPeekReader {
+public:
+  EbmlPeekReader(IOCallback & aStream)
+    :Stream(aStream), WindowSize(0), WindowUsed(0)
+  {}
+
+  bool ReadByte(binary & Byte) {
+    if (WindowUsed == WindowSize) {
+      Sync();
+      WindowSize = Stream.peek(Window, sizeof(Window));
+      if (WindowSize == 0)
+        return false;
+    }
+    Byte = Window[WindowUsed++];
+    return true;
+  }
+
+  // move the stream's file pointer behind the bytes read so far
+  void Sync() {
+    if (WindowUsed != 0)
+      Stream.consume(WindowUsed);
+    WindowSize = WindowUsed = 0;
+  }
+
+protected:
+  IOCallback & Stream;
+  binary Window[16];
+  uint32 WindowSize, WindowUsed;
+};
+
 /*!
   \todo replace the new RawElement with the appropriate class (when known)
   \todo skip data for Dummy elements when they are not allowed
@@ -378,6 +705,7 @@ EbmlElement * EbmlElement::FindNextElement(IOCallback & DataStream, const EbmlSe
   bool bFound;
   int UpperLevel_original = UpperLevel;
   uint64 ParseStart = DataStream.getFilePointer();
+  EbmlPeekReader Reader(DataStream);
 
   do {
     // read a potential ID
@@ -408,16 +736,18 @@ EbmlElement * EbmlElement::FindNextElement(IOCallback & DataStream, const EbmlSe
 
       if (MaxDataSize <= ReadSize)
         break;
-      if (DataStream.read(&PossibleIdNSize[ReadIndex++], 1) == 0) {
+      if (!Reader.ReadByte(PossibleIdNSize[ReadIndex++])) {
         return NULL; // no more data ?
       }
       ReadSize++;
 
     } while (!bFound);
 
-    if (!bFound)
+    if (!bFound) {
       // we reached the maximum we could read without a proper ID
+      Reader.Sync();
       return NULL;
+    }
 
     SizeIdx = ReadIndex;
     ReadIndex -= PossibleID_Length;
@@ -440,7 +770,7 @@ EbmlElement * EbmlElement::FindNextElement(IOCallback & DataStream, const EbmlSe
         bFound = false;
         break;
       }
-      if( DataStream.read( &PossibleIdNSize[SizeIdx++], 1 ) == 0 ) {
+      if (!Reader.ReadByte(PossibleIdNSize[SizeIdx++])) {
         return NULL; // no more data ?
       }
       ReadSize++;
@@ -484,6 +814,7 @@ EbmlElement * EbmlElement::FindNextElement(IOCallback & DataStream, const EbmlSe
     UpperLevel = UpperLevel_original;
   } while ( MaxDataSize >= ReadSize );
 
+  Reader.Sync();
   return NULL;
 }
 
@@ -547,49 +878,23 @@ EbmlElement * EbmlElement::SkipData(EbmlStream & DataStream, const EbmlSemanticC
 }
 
 EbmlElement *EbmlElement::CreateElementUsingContext(const EbmlId & aID, const EbmlSemanticContext & Context,
-                                                    int & LowLevel, bool IsGlobalContext, bool bAllowDummy, unsigned int MaxLowerLevel)
+                                                    int & LowLevel, bool IsGlobalContext, bool bAllowDummy, unsigned int /* MaxLowerLevel */)
 {
-  unsigned int ContextIndex;
   EbmlElement *Result = NULL;
 
-  // elements at the current level
-  for (ContextIndex = 0; ContextIndex < EBML_CTX_SIZE(Context); ContextIndex++) {
-    if (aID == EBML_CTX_IDX_ID(Context,ContextIndex)) {
-      return &EBML_SEM_CREATE(EBML_CTX_IDX(Context,ContextIndex));
-    }
-  }
-
-  // global elements
+  // the context, its global context, its master and its parents are
+  // searched in this order, see EbmlSemanticLookup
   assert(Context.GetGlobalContext != NULL); // global should always exist, at least the EBML ones
-  const EbmlSemanticContext & tstContext = Context.GetGlobalContext();
-  if (tstContext != Context) {
-    LowLevel--;
-    MaxLowerLevel--;
-    // recursive is good, but be carefull...
-    Result = CreateElementUsingContext(aID, tstContext, LowLevel, true, bAllowDummy, MaxLowerLevel);
-    if (Result != NULL) {
-      return Result;
-    }
-    LowLevel++;
-    MaxLowerLevel++;
-  } else {
-    return NULL;
+  const EbmlSemanticLookup & Lookup = Context.GetLookup();
+  const EbmlSemanticLookup::Entry *Found = Lookup.Find(aID);
+  if (Found != NULL) {
+    LowLevel += Found->LevelDelta;
+    return &EBML_INFO_CREATE(*Found->Callbacks);
   }
 
-  // parent elements
-  if (EBML_CTX_MASTER(Context) != NULL && aID == EBML_INFO_ID(*EBML_CTX_MASTER(Context))) {
-    LowLevel++; // already one level up (same as context)
-    return &EBML_INFO_CREATE(*EBML_CTX_MASTER(Context));
-  }
-
-  // check wether it's not part of an upper context
-  if (EBML_CTX_PARENT(Context) != NULL) {
-    LowLevel++;
-    MaxLowerLevel++;
-    return CreateElementUsingContext(aID, *EBML_CTX_PARENT(Context), LowLevel, IsGlobalContext, bAllowDummy, MaxLowerLevel);
-  }
+  LowLevel += Lookup.MissLevelDelta;
 
-  if (!IsGlobalContext && bAllowDummy) {
+  if (Lookup.MissAllowsDummy && !IsGlobalContext && bAllowDummy) {
     LowLevel = 0;
     Result = new (std::nothrow) EbmlDummy(aID);
   }
@@ -694,6 +999,7 @@ bool EbmlElement::ForceSize(uint64 NewSize)
 
   if (CodedSizeLength(Size, SizeLength, bSizeIsFinite) == OldSizeLen) {
     bSizeIsFinite = true;
+    SizeMayHaveChanged();
     return true;
   }
   Size = OldSize;
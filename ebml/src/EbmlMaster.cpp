@@ -46,6 +46,7 @@ START_LIBEBML_NAMESPACE
 
 EbmlMaster::EbmlMaster(const EbmlSemanticContext & aContext, bool bSizeIsknown)
  :EbmlElement(0), Context(aContext), bChecksumUsed(bChecksumUsedByDefault)
+ ,bSizeCached(false), bSizeCacheable(true), bCachedWithDefault(false), bCachedForceRender(false), CachedSizeGeneration(0)
 {
   SetSizeIsFinite(bSizeIsknown);
   SetValueIsSet();
@@ -58,6 +59,7 @@ EbmlMaster::EbmlMaster(const EbmlMaster & ElementToClone)
  ,Context(ElementToClone.Context)
  ,bChecksumUsed(ElementToClone.bChecksumUsed)
  ,Checksum(ElementToClone.Checksum)
+ ,bSizeCached(false), bSizeCacheable(true), bCachedWithDefault(false), bCachedForceRender(false), CachedSizeGeneration(0)
 {
   // add a clone of the list
   std::vector<EbmlElement *>::const_iterator Itr = ElementToClone.ElementList.begin();
@@ -124,21 +126,31 @@ filepos_t EbmlMaster::RenderData(IOCallback & output, bool bForceRender, bool bW
 bool EbmlMaster::PushElement(EbmlElement & element)
 {
   ElementList.push_back(&element);
+  SizeMayHaveChanged();
   return true;
 }
 
+/*!
+  \note The size is only computed again if any element has changed since
+    the last call with the same parameters.
+*/
 uint64 EbmlMaster::UpdateSize(bool bWithDefault, bool bForceRender)
 {
-  SetSize_(0);
-
-  if (!IsFiniteSize())
+  if (!IsFiniteSize()) {
+    SetSize_(0);
     return (0-1);
+  }
+
+  if (bSizeCached && (CachedSizeGeneration == GetSizeGeneration()) && (bCachedWithDefault == bWithDefault) && (bCachedForceRender == bForceRender))
+    return GetSize();
 
   if (!bForceRender) {
     assert(CheckMandatory());
     }
 
   size_t Index;
+  uint64 NewSize = 0;
+  bool bCacheable = true;
 
   for (Index = 0; Index < ElementList.size(); Index++) {
     if (!bWithDefault && (ElementList[Index])->IsDefaultValue())
@@ -146,15 +158,27 @@ uint64 EbmlMaster::UpdateSize(bool bWithDefault, bool bForceRender)
     (ElementList[Index])->UpdateSize(bWithDefault, bForceRender);
     uint64 SizeToAdd = (ElementList[Index])->ElementSize(bWithDefault);
 #if defined(LIBEBML_DEBUG)
-    if (static_cast<int64>(SizeToAdd) == (0-1))
+    if (static_cast<int64>(SizeToAdd) == (0-1)) {
+      SetSize_(NewSize);
+      bSizeCached = false;
       return (0-1);
+    }
 #endif // LIBEBML_DEBUG
-    SetSize_(GetSize() + SizeToAdd);
+    NewSize += SizeToAdd;
+    bCacheable = bCacheable && (ElementList[Index])->IsSizeCacheable();
   }
   if (bChecksumUsed) {
-    SetSize_(GetSize() + Checksum.ElementSize());
+    NewSize += Checksum.ElementSize();
   }
 
+  SetSize_(NewSize);
+
+  bSizeCached = bCacheable;
+  bSizeCacheable = bCacheable;
+  bCachedWithDefault = bWithDefault;
+  bCachedForceRender = bForceRender;
+  CachedSizeGeneration = GetSizeGeneration();
+
   return GetSize();
 }
 
@@ -394,6 +418,7 @@ EbmlElement *EbmlMaster::AddNewElt(const EbmlCallbacks & Callbacks)
 void EbmlMaster::Sort()
 {
   std::sort(ElementList.begin(), ElementList.end(), EbmlElement::CompareElements);
+  SizeMayHaveChanged();
 }
 
 /*!
@@ -415,6 +440,7 @@ void EbmlMaster::Read(EbmlStream & inDataStream, const EbmlSemanticContext & sCo
     }
   }
   ElementList.clear();
+  SizeMayHaveChanged();
   uint64 MaxSizeToRead;
 
   if (IsFiniteSize())
@@ -451,7 +477,7 @@ void EbmlMaster::Read(EbmlStream & inDataStream, const EbmlSemanticContext & sCo
         // e.g. if block data is defective.
         bool DeleteElement = true;
 
-        if (ElementLevelA->ValueIsSet() || (ReadFully != SCOPE_ALL_DATA)) {
+        if (ElementLevelA->ValueIsSet() || ((ReadFully != SCOPE_ALL_DATA) && (ReadFully != SCOPE_LAZY_DATA))) {
           ElementList.push_back(ElementLevelA);
           DeleteElement = false;
         }
@@ -531,17 +557,20 @@ void EbmlMaster::Remove(size_t Index)
     }
 
     ElementList.erase(Itr);
+    SizeMayHaveChanged();
   }
 }
 
 void EbmlMaster::Remove(EBML_MASTER_ITERATOR & Itr)
 {
   ElementList.erase(Itr);
+  SizeMayHaveChanged();
 }
 
 void EbmlMaster::Remove(EBML_MASTER_RITERATOR & Itr)
 {
   ElementList.erase(Itr.base());
+  SizeMayHaveChanged();
 }
 
 bool EbmlMaster::VerifyChecksum() const
@@ -571,6 +600,7 @@ bool EbmlMaster::InsertElement(EbmlElement & element, size_t position)
     return false;
 
   ElementList.insert(Itr, &element);
+  SizeMayHaveChanged();
   return true;
 }
 
@@ -585,6 +615,7 @@ bool EbmlMaster::InsertElement(EbmlElement & element, const EbmlElement & before
     return false;
 
   ElementList.insert(Itr, &element);
+  SizeMayHaveChanged();
   return true;
 }
 
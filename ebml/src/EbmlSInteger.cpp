@@ -110,31 +110,34 @@ uint64 EbmlSInteger::UpdateSize(bool bWithDefault, bool /* bForceRender */)
   if (!bWithDefault && IsDefaultValue())
     return 0;
 
+  uint64 NewSize;
   if (Value <= 0x7F && Value >= (-0x80)) {
-    SetSize_(1);
+    NewSize = 1;
   } else if (Value <= 0x7FFF && Value >= (-0x8000)) {
-    SetSize_(2);
+    NewSize = 2;
   } else if (Value <= 0x7FFFFF && Value >= (-0x800000)) {
-    SetSize_(3);
+    NewSize = 3;
   } else if (Value <= EBML_PRETTYLONGINT(0x7FFFFFFF) && Value >= (EBML_PRETTYLONGINT(-0x80000000))) {
-    SetSize_(4);
+    NewSize = 4;
   } else if (Value <= EBML_PRETTYLONGINT(0x7FFFFFFFFF) &&
              Value >= EBML_PRETTYLONGINT(-0x8000000000)) {
-    SetSize_(5);
+    NewSize = 5;
   } else if (Value <= EBML_PRETTYLONGINT(0x7FFFFFFFFFFF) &&
              Value >= EBML_PRETTYLONGINT(-0x800000000000)) {
-    SetSize_(6);
+    NewSize = 6;
   } else if (Value <= EBML_PRETTYLONGINT(0x7FFFFFFFFFFFFF) &&
              Value >= EBML_PRETTYLONGINT(-0x80000000000000)) {
-    SetSize_(7);
+    NewSize = 7;
   } else {
-    SetSize_(8);
+    NewSize = 8;
   }
 
-  if (GetDefaultSize() > GetSize()) {
-    SetSize_(GetDefaultSize());
+  if (GetDefaultSize() > NewSize) {
+    NewSize = GetDefaultSize();
   }
 
+  SetSize_(NewSize);
+
   return GetSize();
 }
 
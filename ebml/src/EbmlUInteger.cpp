@@ -107,28 +107,32 @@ uint64 EbmlUInteger::UpdateSize(bool bWithDefault, bool /* bForceRender */)
   if (!bWithDefault && IsDefaultValue())
     return 0;
 
+  uint64 NewSize;
   if (Value <= 0xFF) {
-    SetSize_(1);
+    NewSize = 1;
   } else if (Value <= 0xFFFF) {
-    SetSize_(2);
+    NewSize = 2;
   } else if (Value <= 0xFFFFFF) {
-    SetSize_(3);
+    NewSize = 3;
   } else if (Value <= 0xFFFFFFFF) {
-    SetSize_(4);
+    NewSize = 4;
   } else if (Value <= EBML_PRETTYLONGINT(0xFFFFFFFFFF)) {
-    SetSize_(5);
+    NewSize = 5;
   } else if (Value <= EBML_PRETTYLONGINT(0xFFFFFFFFFFFF)) {
-    SetSize_(6);
+    NewSize = 6;
   } else if (Value <= EBML_PRETTYLONGINT(0xFFFFFFFFFFFFFF)) {
-    SetSize_(7);
+    NewSize = 7;
   } else {
-    SetSize_(8);
+    NewSize = 8;
   }
 
-  if (GetDefaultSize() > GetSize()) {
-    SetSize_(GetDefaultSize());
+  if (GetDefaultSize() > NewSize) {
+    NewSize = GetDefaultSize();
   }
 
+  // set only once as each change of a size is counted
+  SetSize_(NewSize);
+
   return GetSize();
 }
 
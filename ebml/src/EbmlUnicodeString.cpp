@@ -297,9 +297,10 @@ uint64 EbmlUnicodeString::UpdateSize(bool bWithDefault, bool /* bForceRender */)
   if (!bWithDefault && IsDefaultValue())
     return 0;
 
-  SetSize_(Value.GetUTF8().length());
-  if (GetSize() < GetDefaultSize())
-    SetSize_(GetDefaultSize());
+  uint64 NewSize = Value.GetUTF8().length();
+  if (NewSize < GetDefaultSize())
+    NewSize = GetDefaultSize();
+  SetSize_(NewSize);
 
   return GetSize();
 }
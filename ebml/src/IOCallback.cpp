@@ -78,4 +78,19 @@ void IOCallback::readFully(void*Buffer,size_t Size)
   }
 }
 
+uint32 IOCallback::peek(void*Buffer,size_t Size)
+{
+  uint64 Position = getFilePointer();
+  uint32 Read = read(Buffer,Size);
+  setFilePointer(Position);
+  return Read;
+}
+
+
+
+void IOCallback::consume(size_t Size)
+{
+  setFilePointer(Size,seek_current);
+}
+
 END_LIBEBML_NAMESPACE
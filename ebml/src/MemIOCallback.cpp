@@ -83,6 +83,19 @@ uint32 MemIOCallback::read(void *Buffer, size_t Size)
   return Size;
 }
 
+uint32 MemIOCallback::peek(void *Buffer, size_t Size)
+{
+  if (Buffer == NULL || dataBufferPos >= dataBufferTotalSize)
+    return 0;
+
+  if (Size > dataBufferTotalSize - dataBufferPos)
+    Size = dataBufferTotalSize - dataBufferPos;
+
+  memcpy(Buffer, dataBuffer + dataBufferPos, Size);
+
+  return Size;
+}
+
 void MemIOCallback::setFilePointer(int64 Offset, seek_mode Mode)
 {
   if (Mode == seek_beginning)
@@ -224,6 +224,7 @@ class MATROSKA_DLL_API KaxInternalBlock : public EbmlBinary {
       \note override this function to generate the Data/Size on the fly, unlike the usual binary elements
     */
     filepos_t UpdateSize(bool bSaveDefault = false, bool bForceRender = false);
+    bool IsSizeCacheable() const {return false;}
     filepos_t ReadData(IOCallback & input, ScopeMode ReadFully = SCOPE_ALL_DATA);
 
     /*!
@@ -367,6 +368,7 @@ DECLARE_MKX_BINARY_CONS(KaxBlockVirtual)
       \note override this function to generate the Data/Size on the fly, unlike the usual binary elements
     */
     filepos_t UpdateSize(bool bSaveDefault = false, bool bForceRender = false);
+    bool IsSizeCacheable() const {return false;}
 
     void SetParent(const KaxCluster & aParentCluster) {ParentCluster = &aParentCluster;}
 
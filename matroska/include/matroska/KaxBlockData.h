@@ -54,6 +54,7 @@ DECLARE_MKX_SINTEGER_CONS(KaxReferenceBlock)
       \brief override this method to compute the timecode value
     */
     virtual filepos_t UpdateSize(bool bSaveDefault = false, bool bForceRender = false);
+    virtual bool IsSizeCacheable() const {return false;}
 
     const KaxBlockBlob & RefBlock() const;
     void SetReferencedBlock(const KaxBlockBlob * aRefdBlock);
@@ -455,8 +455,9 @@ filepos_t KaxInternalBlock::ReadData(IOCallback & input, ScopeMode ReadFully)
   SetValueIsSet(false);
 
   try {
-    if (ReadFully == SCOPE_ALL_DATA) {
-      Result = EbmlBinary::ReadData(input, ReadFully);
+    // The frames point into the data. It cannot be loaded lazily.
+    if ((ReadFully == SCOPE_ALL_DATA) || (ReadFully == SCOPE_LAZY_DATA)) {
+      Result = EbmlBinary::ReadData(input, SCOPE_ALL_DATA);
       if (Result != GetSize())
         throw SafeReadIOCallback::EndOfStreamX(GetSize() - Result);
 